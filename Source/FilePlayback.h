@@ -0,0 +1,351 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Flat binary and NPY playback
+
+
+Plays a pre-generated dataset through the normal conversion path, for regression and load
+testing without a network stack. The file is memory mapped and read front to back:
+	.npy            2D (samples, channels) C order array of <f4, <f8, <i2 or <i4
+	.dat            interleaved int16, as written by the Open Ephys binary format
+	anything else   interleaved float32
+Channel count comes from the NPY header; for flat files it, and the sample rate in all cases,
+are the ones set in the editor. Samples are timestamped index / sample rate.
+
+Markers come from an optional sidecar with the same name and the extension .events, one per
+line: the sample index (from the start of the file) and the marker text, separated by
+whitespace. Lines starting with # are skipped.
+
+Blocks of the configured size are handed out on the replay speed's schedule (0 for as fast as
+possible). On POSIX the mapping is advised for sequential access, the next window is
+prefetched and pages already played are released, so a multi GB file plays with a small
+resident set.
+*/
+
+#ifndef OEP_FILE_PLAYBACK_H_INCLUDED
+#define OEP_FILE_PLAYBACK_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <algorithm>
+#include "ReplaySource.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace LSLinletNode
+{
+	const int64 FILE_READAHEAD_BYTES = 16 << 20;
+
+	enum FileSampleType
+	{
+		FILE_FLOAT32,
+		FILE_FLOAT64,
+		FILE_INT16,
+		FILE_INT32
+	};
+
+	class FilePlayback : public ReplaySource
+	{
+	public:
+		/*
+		* @param f data file
+		* @param speed playback speed, 0 for as fast as possible
+		* @param nChans channels of a flat file
+		* @param srate sample rate of the data
+		*/
+		FilePlayback(const File& f, float speed, int nChans, double srate) :
+			ReplaySource(f),
+			map(f, MemoryMappedFile::readOnly),
+			pacer(speed),
+			type(FILE_FLOAT32),
+			dataOffset(0),
+			numSamples(0),
+			startSample(0),
+			pos(0),
+			nextEvent(0),
+			advisedTo(0),
+			releasedTo(0),
+			played(0),
+			statStart(0)
+		{
+			base = (const uint8*)map.getData();
+			if (base == nullptr || srate <= 0) {
+				return;
+			}
+			numChannels = nChans;
+			sampleRate = srate;
+
+			if (file.hasFileExtension("npy")) {
+				if (!parseNpyHeader()) {
+					return;
+				}
+			}
+			else if (file.hasFileExtension("dat")) {
+				type = FILE_INT16;
+			}
+			if (numChannels <= 0) {
+				return;
+			}
+			numSamples = ((int64)map.getSize() - dataOffset) / ((int64)numChannels * sampleBytes());
+
+#ifndef _WIN32
+			madvise((void*)pageAlign(base), map.getSize() + (base - pageAlign(base)), MADV_SEQUENTIAL);
+#endif
+			loadEvents(file.withFileExtension("events"));
+
+			restart();
+			success = numSamples > 0;
+		}
+
+		String describe() const override {
+			return "playback of " + file.getFileName() + ", " + String(numChannels) + " channels, "
+				+ String(numSamples / sampleRate, 1) + " s";
+		}
+
+		void restart() override {
+			pos = startSample;
+			pacer.restart();
+			nextEvent = std::lower_bound(events.begin(), events.end(), std::make_pair(startSample, std::string())) - events.begin();
+			advisedTo = 0;
+			releasedTo = 0;
+			advise();
+		}
+
+		bool seek(double seconds) override {
+			int64 target = int64(seconds * sampleRate);
+			if (target < 0 || target >= numSamples) {
+				return false;
+			}
+			startSample = target;
+			restart();
+			return true;
+		}
+
+		int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) override {
+			eventStr->clear();
+			eventInd->clear();
+
+			if (pos >= numSamples) {
+				Thread::sleep(int(timeout * 1000));
+				return 0;
+			}
+
+			// A block is due once its last sample is
+			int n = (int)jmin<int64>(maxSamps, numSamples - pos);
+			if (!pacer.waitFor((pos + n - 1) / sampleRate, timeout)) {
+				return 0;
+			}
+
+			const uint8* src = base + dataOffset + pos * numChannels * sampleBytes();
+			const int count = n * numChannels;
+			switch (type) {
+			case FILE_FLOAT32:
+				memcpy(dataBuf, src, count * sizeof(float));
+				break;
+			case FILE_FLOAT64:
+				convert((const double*)src, dataBuf, count);
+				break;
+			case FILE_INT16:
+				convert((const int16*)src, dataBuf, count);
+				break;
+			case FILE_INT32:
+				convert((const int32*)src, dataBuf, count);
+				break;
+			}
+			for (int i = 0; i < n; i++) {
+				tsBuf[i] = (pos - startSample + i) / sampleRate;
+			}
+
+			while (nextEvent < events.size() && events[nextEvent].first < pos + n) {
+				eventStr->push_back(events[nextEvent].second);
+				eventInd->push_back(int(events[nextEvent].first - pos));
+				nextEvent++;
+			}
+
+			pos += n;
+			played += n;
+			advise();
+			return n;
+		}
+
+		void printStats() override {
+			double now = Time::getMillisecondCounterHiRes() / 1000.0;
+			if (played > 0 && statStart > 0) {
+				std::cout << "Playback " << file.getFileName() << ": " << played << " samples, "
+					<< played / sampleRate / (now - statStart) << "x real time, at "
+					<< pos / sampleRate << " of " << numSamples / sampleRate << " s" << std::endl;
+			}
+			played = 0;
+			statStart = now;
+		}
+
+	private:
+		/*
+		* Reads dtype and shape from the NPY header, see numpy.lib.format
+		*/
+		bool parseNpyHeader() {
+			const int64 size = (int64)map.getSize();
+			if (size < 10 || memcmp(base, "\x93NUMPY", 6) != 0) {
+				return false;
+			}
+			int64 headerLen;
+			if (base[6] == 1) {
+				headerLen = base[8] | (base[9] << 8);
+				dataOffset = 10 + headerLen;
+			}
+			else {
+				if (size < 12) {
+					return false;
+				}
+				headerLen = base[8] | (base[9] << 8) | (base[10] << 16) | ((int64)base[11] << 24);
+				dataOffset = 12 + headerLen;
+			}
+			if (dataOffset > size) {
+				return false;
+			}
+			String header = String::fromUTF8((const char*)base + dataOffset - headerLen, (int)headerLen);
+
+			String descr = header.fromFirstOccurrenceOf("'descr':", false, false)
+				.fromFirstOccurrenceOf("'", false, false).upToFirstOccurrenceOf("'", false, false);
+			if (descr == "<f4") {
+				type = FILE_FLOAT32;
+			}
+			else if (descr == "<f8") {
+				type = FILE_FLOAT64;
+			}
+			else if (descr == "<i2") {
+				type = FILE_INT16;
+			}
+			else if (descr == "<i4") {
+				type = FILE_INT32;
+			}
+			else {
+				std::cout << "Unsupported NPY dtype " << descr << std::endl;
+				return false;
+			}
+			if (header.fromFirstOccurrenceOf("'fortran_order':", false, false).trimStart().startsWith("True")) {
+				std::cout << "NPY playback needs C order (samples, channels)" << std::endl;
+				return false;
+			}
+
+			StringArray shape = StringArray::fromTokens(header.fromFirstOccurrenceOf("'shape':", false, false)
+				.fromFirstOccurrenceOf("(", false, false).upToFirstOccurrenceOf(")", false, false), ",", "");
+			shape.trim();
+			shape.removeEmptyStrings();
+			numChannels = shape.size() == 1 ? 1 : shape.size() == 2 ? shape[1].getIntValue() : 0;
+			return numChannels > 0;
+		}
+
+		void loadEvents(const File& sidecar) {
+			events.clear();
+			if (!sidecar.existsAsFile()) {
+				return;
+			}
+			StringArray lines = StringArray::fromLines(sidecar.loadFileAsString());
+			for (int i = 0; i < lines.size(); i++) {
+				String line = lines[i].trim();
+				if (line.isEmpty() || line.startsWithChar('#')) {
+					continue;
+				}
+				const int split = line.indexOfAnyOf(" \t");
+				if (split < 0) {
+					continue;
+				}
+				int64 sample = line.substring(0, split).getLargeIntValue();
+				String text = line.substring(split).trim();
+				events.push_back(std::make_pair(sample, text.toStdString()));
+			}
+			std::stable_sort(events.begin(), events.end(),
+				[](const std::pair<int64, std::string>& a, const std::pair<int64, std::string>& b) { return a.first < b.first; });
+		}
+
+		int sampleBytes() const {
+			return type == FILE_FLOAT64 ? 8 : type == FILE_INT16 ? 2 : 4;
+		}
+
+		template <typename T>
+		static void convert(const T* src, float* dst, int count) {
+			for (int i = 0; i < count; i++) {
+				dst[i] = float(src[i]);
+			}
+		}
+
+		/*
+		* Prefetch the window ahead of the read position and drop what was played
+		*/
+		void advise() {
+#ifndef _WIN32
+			const int64 at = dataOffset + pos * numChannels * sampleBytes();
+			const int64 size = (int64)map.getSize();
+			if (at + FILE_READAHEAD_BYTES / 2 > advisedTo && advisedTo < size) {
+				int64 from = jmax(at, advisedTo);
+				int64 to = jmin(size, at + FILE_READAHEAD_BYTES);
+				const uint8* start = pageAlign(base + from);
+				madvise((void*)start, (base + to) - start, MADV_WILLNEED);
+				advisedTo = to;
+			}
+			if (at - releasedTo > FILE_READAHEAD_BYTES) {
+				const uint8* start = pageAlign(base + releasedTo);
+				const uint8* end = pageAlign(base + at);
+				if (end > start) {
+					madvise((void*)start, end - start, MADV_DONTNEED);
+				}
+				releasedTo = at;
+			}
+#endif
+		}
+
+#ifndef _WIN32
+		static const uint8* pageAlign(const uint8* p) {
+			static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+			return (const uint8*)((uintptr_t)p & ~(page - 1));
+		}
+#endif
+
+		MemoryMappedFile map;
+		const uint8* base;
+		ReplayPacer pacer;
+
+		FileSampleType type;
+		int64 dataOffset;
+		int64 numSamples;
+		int64 startSample;
+		int64 pos;
+
+		std::vector<std::pair<int64, std::string>> events;
+		size_t nextEvent;
+
+		int64 advisedTo;
+		int64 releasedTo;
+
+		int64 played;
+		double statStart;
+
+		JUCE_LEAK_DETECTOR(FilePlayback);
+	};
+}
+
+#endif // OEP_FILE_PLAYBACK_H_INCLUDED
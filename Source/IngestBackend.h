@@ -0,0 +1,101 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Ingest backend
+
+
+Where LSLinlet gets its data from: the live LSL inlet, a capture or XDF file, or a framed
+binary socket. Everything after pullChunk (trigger decoding, decimation, filtering, batching,
+TTL words) is the same for all of them.
+*/
+
+#ifndef OEP_INGEST_BACKEND_H_INCLUDED
+#define OEP_INGEST_BACKEND_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <string>
+#include <vector>
+
+namespace LSLinletNode
+{
+	class IngestBackend
+	{
+	public:
+		IngestBackend() : success(false), numChannels(0), sampleRate(0) {}
+		virtual ~IngestBackend() {}
+
+		/*
+		* Connect to the source. Sets success, numChannels and sampleRate.
+		* @return success
+		*/
+		virtual bool open() = 0;
+
+		/*
+		* Short description of the source for the log
+		*/
+		virtual String describe() const = 0;
+
+		/*
+		* Pull up to maxSamps multiplexed samples straight into dataBuf (numChannels per sample)
+		* and their timestamps into tsBuf, blocking up to timeout for the first one. Markers that
+		* belong to the pulled samples are returned with the index of their sample.
+		* @return number of samples pulled
+		*/
+		virtual int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) = 0;
+
+		/*
+		* Markers that came with the last pullChunk as numbers (e.g. from a cf_int32 marker
+		* stream), and the index of their sample. They are not among pullChunk's text markers.
+		*/
+		virtual void takeNumericMarkers(std::vector<int>* codes, std::vector<int>* inds) {
+			codes->clear();
+			inds->clear();
+		}
+
+		/*
+		* True while the source's backlog is past its overload threshold
+		*/
+		virtual bool overloaded() {
+			return false;
+		}
+
+		/*
+		* Called when acquisition starts
+		*/
+		virtual void restart() {}
+
+		virtual void close() {}
+
+		/*
+		* Print statistics gathered since the last call
+		*/
+		virtual void printStats() {}
+
+		bool success;
+		int numChannels;
+		double sampleRate;
+	};
+}
+
+#endif // OEP_INGEST_BACKEND_H_INCLUDED
@@ -0,0 +1,260 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Stream alignment
+
+
+Places events from other inlets onto the samples of the data stream, once every timestamp
+has been mapped into the local clock domain. A marker lands on the first sample at or after
+its timestamp. Markers newer than the data released so far are held until the data catches
+up, so a marker that overtakes the EEG on the network still lands on the right sample.
+
+Markers can also arrive after the samples they belong to have been released, e.g. when they
+come from a slower host. With a reorder window, data samples are held back until they are
+that much older than the newest sample, which gives late markers that long to arrive. The
+window is the only latency this stage adds. A marker later than the window lands on the
+first sample released after it and is counted as late. If irregular timestamps overfill the
+delay line, its oldest samples are dropped and counted. A marker whose data has not shown up
+after MAX_MARKER_HOLD seconds (e.g. a wrong clock) lands on the newest sample instead.
+
+Waiting text markers are kept in fixed MARKER_TEXT_BYTES buffers, cut to fit, which is plenty
+for the number TTL parsing reads from them. They become strings again when handed out.
+*/
+
+#ifndef OEP_LSL_ALIGNER_H_INCLUDED
+#define OEP_LSL_ALIGNER_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include "LSLMarkers.h"
+
+namespace LSLinletNode
+{
+	const double MAX_MARKER_HOLD = 1.0;
+
+	class StreamAligner
+	{
+	public:
+		StreamAligner() :
+			window(0),
+			numChans(0),
+			capacity(0),
+			head(0),
+			count(0),
+			newestTs(0),
+			lastReleasedTs(0),
+			lateMarkers(0),
+			maxLateness(0),
+			droppedSamples(0)
+		{
+		}
+
+		/*
+		* @param nChans channels of the data stream
+		* @param srate nominal rate of the data stream
+		* @param maxChunk most samples pushed at once
+		* @param windowSec how long data is held back for late markers, 0 for no delay
+		*/
+		void configure(int nChans, double srate, int maxChunk, double windowSec) {
+			window = windowSec;
+			numChans = nChans;
+			capacity = window > 0 ? int(std::ceil(window * srate)) + 2 * maxChunk : 0;
+			data.assign(capacity * numChans, 0.0f);
+			times.assign(capacity, 0.0);
+			pending.reserve(64);
+			reset();
+		}
+
+		void reset() {
+			head = 0;
+			count = 0;
+			lastReleasedTs = -HUGE_VAL;
+			pending.clear();
+			lateMarkers = 0;
+			maxLateness = 0;
+			droppedSamples = 0;
+		}
+
+		bool isDelaying() const {
+			return window > 0;
+		}
+
+		/*
+		* Queue a marker, its timestamp already in the local clock domain
+		*/
+		void addMarker(const std::string& text, double ts) {
+			PendingMarker marker;
+			marker.ts = ts;
+			marker.arrival = lsl::local_clock();
+			marker.code = 0;
+			marker.numeric = false;
+			marker.length = (int)jmin(text.size(), (size_t)MARKER_TEXT_BYTES);
+			memcpy(marker.text, text.data(), marker.length);
+			insert(marker);
+		}
+
+		/*
+		* Queue a numeric marker, which stays a number
+		*/
+		void addMarker(int code, double ts) {
+			PendingMarker marker;
+			marker.ts = ts;
+			marker.arrival = lsl::local_clock();
+			marker.code = code;
+			marker.numeric = true;
+			marker.length = 0;
+			insert(marker);
+		}
+
+		/*
+		* Append samples to the delay line
+		*/
+		void pushSamples(const float* src, const double* ts, int n) {
+			for (int i = 0; i < n; i++) {
+				// Only reachable with irregular timestamps, make room by dropping the oldest sample
+				if (count == capacity) {
+					head = (head + 1) % capacity;
+					count--;
+					droppedSamples++;
+				}
+				int slot = (head + count) % capacity;
+				memcpy(&data[slot * numChans], src + i * numChans, numChans * sizeof(float));
+				times[slot] = ts[i];
+				count++;
+			}
+			if (n > 0) {
+				newestTs = ts[n - 1];
+			}
+		}
+
+		/*
+		* Release samples that are at least the window older than the newest one
+		* @return number of samples written
+		*/
+		int popSamples(float* dest, double* ts, int maxSamps) {
+			int n = 0;
+			while (n < maxSamps && count > 0 && times[head] <= newestTs - window) {
+				memcpy(dest + n * numChans, &data[head * numChans], numChans * sizeof(float));
+				ts[n++] = times[head];
+				head = (head + 1) % capacity;
+				count--;
+			}
+			return n;
+		}
+
+		/*
+		* Place every queued marker that is due on the samples about to be released
+		* @param ts local clock timestamps of the released samples
+		* @param eventStr, eventInd text markers and the index of their sample
+		* @param eventCode, codeInd numeric markers and the index of their sample
+		*/
+		void assignMarkers(const double* ts, int n, std::vector<std::string>* eventStr, std::vector<int>* eventInd,
+			std::vector<int>* eventCode, std::vector<int>* codeInd) {
+			if (n == 0) {
+				return;
+			}
+			double now = lsl::local_clock();
+			int ind = 0;
+			size_t used = 0;
+			while (used < pending.size()) {
+				const PendingMarker& marker = pending[used];
+				if (marker.ts > ts[n - 1] && now - marker.arrival < MAX_MARKER_HOLD) {
+					break;
+				}
+				used++;
+
+				while (ind < n - 1 && ts[ind] < marker.ts) {
+					ind++;
+				}
+				if (marker.ts <= lastReleasedTs) {
+					lateMarkers++;
+					maxLateness.store(jmax(maxLateness.load(), ts[0] - marker.ts));
+				}
+				if (marker.numeric) {
+					eventCode->push_back(marker.code);
+					codeInd->push_back(ind);
+				}
+				else {
+					eventStr->emplace_back(marker.text, marker.length);
+					eventInd->push_back(ind);
+				}
+			}
+			pending.erase(pending.begin(), pending.begin() + used);
+			lastReleasedTs = ts[n - 1];
+		}
+
+		// Markers that arrived after the samples they belonged to were released, and by how much
+		int64 lateCount() const { return lateMarkers.load(); }
+		double maxLatenessSeconds() const { return maxLateness.load(); }
+		// Samples dropped from a full delay line before they were released
+		int64 droppedCount() const { return droppedSamples.load(); }
+
+	private:
+		struct PendingMarker
+		{
+			double ts;
+			double arrival;
+			int code;
+			bool numeric;
+			int length;
+			char text[MARKER_TEXT_BYTES];
+		};
+
+		// Keep pending sorted by timestamp
+		void insert(const PendingMarker& marker) {
+			auto pos = pending.end();
+			while (pos != pending.begin() && (pos - 1)->ts > marker.ts) {
+				--pos;
+			}
+			pending.insert(pos, marker);
+		}
+
+		double window;
+		int numChans;
+
+		// Delay line of data samples
+		std::vector<float> data;
+		std::vector<double> times;
+		int capacity;
+		int head;
+		int count;
+		double newestTs;
+		double lastReleasedTs;
+
+		// Markers sorted by timestamp
+		std::vector<PendingMarker> pending;
+
+		// Counted on the acquisition thread, read from the message thread
+		std::atomic<int64> lateMarkers;
+		std::atomic<double> maxLateness;
+		std::atomic<int64> droppedSamples;
+
+		JUCE_LEAK_DETECTOR(StreamAligner);
+	};
+}
+
+#endif // OEP_LSL_ALIGNER_H_INCLUDED
@@ -0,0 +1,192 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Irregular rate binning
+
+
+Puts samples of an irregular rate stream (eye tracker fixations, sporadic sensor values)
+onto a fixed grid so Open Ephys sees a regular rate. Bin i covers the half open interval
+of one grid period centred on its timestamp. The value written for a bin depends on the mode:
+	BIN_HOLD     the newest sample at or before the end of the bin, carried over empty bins
+	BIN_LAST     the newest sample inside the bin, 0 for an empty bin
+	BIN_NEAREST  the sample closest to the bin timestamp, the previous value for an empty bin
+
+Samples are kept sorted by timestamp. Streams nearly always deliver in order, so insertion
+searches from the back and is an append in the common case. A sample older than a bin that
+has already been written is counted as late and dropped.
+*/
+
+#ifndef OEP_LSL_BINNER_H_INCLUDED
+#define OEP_LSL_BINNER_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace LSLinletNode
+{
+	enum BinMode
+	{
+		BIN_HOLD = 0,
+		BIN_LAST = 1,
+		BIN_NEAREST = 2
+	};
+
+	// Grid used for an irregular EEG stream, and how long the grid trails the newest sample
+	const double DEFAULT_GRID_RATE = 100.0;
+	const double GRID_LATENCY = 0.05;
+
+	class IrregularBinner
+	{
+	public:
+		IrregularBinner() :
+			numChans(0),
+			halfPeriod(0),
+			mode(BIN_HOLD),
+			head(0),
+			horizon(-1e300),
+			binned(0),
+			emptyBins(0),
+			lateSamples(0)
+		{
+		}
+
+		/*
+		* @param nChans channels of the irregular stream
+		* @param gridRate rate of the bins the samples are put onto
+		* @param binMode one of BinMode
+		*/
+		void configure(int nChans, double gridRate, int binMode) {
+			numChans = nChans;
+			halfPeriod = 0.5 / gridRate;
+			mode = binMode;
+			held.assign(numChans, 0.0f);
+			reset();
+		}
+
+		void reset() {
+			times.clear();
+			values.clear();
+			head = 0;
+			horizon = -1e300;
+			std::fill(held.begin(), held.end(), 0.0f);
+			binned = 0;
+			emptyBins = 0;
+			lateSamples = 0;
+		}
+
+		/*
+		* Add n multiplexed samples with timestamps in the grid's clock domain
+		*/
+		void insert(const float* data, const double* ts, int n) {
+			for (int i = 0; i < n; i++) {
+				if (ts[i] < horizon) {
+					lateSamples++;
+					continue;
+				}
+				size_t pos = times.size();
+				if (pos > head && ts[i] < times[pos - 1]) {
+					pos = std::upper_bound(times.begin() + head, times.end(), ts[i]) - times.begin();
+				}
+				times.insert(times.begin() + pos, ts[i]);
+				values.insert(values.begin() + pos * numChans, data + i * numChans, data + (i + 1) * numChans);
+			}
+		}
+
+		/*
+		* Write the bins centred on binTs (ascending) into out, consuming the samples they cover
+		* @param stride floats between consecutive bins in out
+		*/
+		void fill(const double* binTs, int n, float* out, int stride) {
+			for (int i = 0; i < n; i++) {
+				const double lo = binTs[i] - halfPeriod;
+				const double hi = binTs[i] + halfPeriod;
+
+				size_t best = SIZE_MAX;
+				double bestDist = 0;
+				while (head < times.size() && times[head] < hi) {
+					if (times[head] >= lo) {
+						double dist = std::abs(times[head] - binTs[i]);
+						if (mode != BIN_NEAREST || best == SIZE_MAX || dist < bestDist) {
+							best = head;
+							bestDist = dist;
+						}
+					}
+					if (mode == BIN_HOLD) {
+						best = head;
+					}
+					head++;
+				}
+
+				float* dst = out + i * stride;
+				if (best != SIZE_MAX) {
+					memcpy(held.data(), &values[best * numChans], numChans * sizeof(float));
+					binned++;
+				}
+				else {
+					emptyBins++;
+				}
+				if (best == SIZE_MAX && mode == BIN_LAST) {
+					std::fill(dst, dst + numChans, 0.0f);
+				}
+				else {
+					memcpy(dst, held.data(), numChans * sizeof(float));
+				}
+				horizon = hi;
+			}
+
+			// Drop consumed samples once they make up most of the storage
+			if (head > 1024 && head * 2 > times.size()) {
+				times.erase(times.begin(), times.begin() + head);
+				values.erase(values.begin(), values.begin() + head * numChans);
+				head = 0;
+			}
+		}
+
+		// Bins that got a sample, bins that did not, and samples that came after their bin
+		int64 binnedCount() const { return binned; }
+		int64 emptyCount() const { return emptyBins; }
+		int64 lateCount() const { return lateSamples; }
+
+	private:
+		int numChans;
+		double halfPeriod;
+		int mode;
+
+		std::vector<double> times;
+		std::vector<float> values;
+		size_t head;
+		double horizon;
+		std::vector<float> held;
+
+		int64 binned;
+		int64 emptyBins;
+		int64 lateSamples;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(IrregularBinner);
+	};
+}
+
+#endif // OEP_LSL_BINNER_H_INCLUDED
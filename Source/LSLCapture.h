@@ -0,0 +1,493 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Capture file for raw LSL traffic
+
+
+Layout
+A fixed header, then records in arrival order, then an index of record offsets.
+Every record starts with a CaptureRecord. Data records carry count timestamps (double)
+followed by count x numChannels values (float), exactly as pulled from the inlet.
+Marker records carry a count byte string. Payloads are padded to 8 bytes.
+
+The file grows in segments and is written through a memory map, so appending a chunk
+from the acquisition thread is a memcpy. The index and final header are written when
+the capture is closed; a capture that was never closed is indexed by scanning. Replay checks
+the header, the index and every record against the file size, and falls back to scanning
+if the stored index does not hold up.
+*/
+
+#ifndef OEP_LSL_CAPTURE_H_INCLUDED
+#define OEP_LSL_CAPTURE_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include "ReplaySource.h"
+
+namespace LSLinletNode
+{
+	const char CAPTURE_MAGIC[8] = { 'L', 'S', 'L', 'C', 'A', 'P', '0', '1' };
+	const int64 CAPTURE_SEGMENT = 64 * 1024 * 1024;
+	const int CAPTURE_MAX_CHANNELS = 65536;
+
+	enum CaptureRecordType
+	{
+		CAPTURE_DATA = 1,
+		CAPTURE_MARKER = 2
+	};
+
+	struct CaptureHeader
+	{
+		char magic[8];
+		int32 version;
+		int32 numChannels;
+		double sampleRate;
+		int64 dataEnd;
+		int64 indexOffset;
+		int64 numRecords;
+		int64 numSamples;
+	};
+
+	struct CaptureRecord
+	{
+		uint32 type;
+		uint32 count;
+		double timestamp;
+	};
+
+	inline int64 capturePadded(int64 bytes)
+	{
+		return (bytes + 7) & ~int64(7);
+	}
+
+	inline int64 captureRecordSize(const CaptureRecord* rec, int numChannels)
+	{
+		int64 payload = rec->type == CAPTURE_DATA
+			? int64(rec->count) * (sizeof(double) + numChannels * sizeof(float))
+			: int64(rec->count);
+		return sizeof(CaptureRecord) + capturePadded(payload);
+	}
+
+	/*
+	Append-only writer. The acquisition thread only copies into the mapped file; growing the file
+	and mapping it again happen on the writer's own thread, a segment ahead of the write position.
+	*/
+	class CaptureWriter : public Thread
+	{
+	public:
+		CaptureWriter(const File& f, int nChans, double srate) :
+			Thread("LSL Capture"),
+			file(f),
+			mappedSize(0),
+			writePos(sizeof(CaptureHeader)),
+			numChannels(nChans),
+			numSamples(0),
+			nextSize(0),
+			requested(0),
+			dropped(0)
+		{
+			file.deleteFile();
+			map = mapFile(CAPTURE_SEGMENT);
+			mappedSize = isOpen() ? (int64)map->getSize() : 0;
+
+			CaptureHeader* header = getHeader();
+			if (header == nullptr) {
+				return;
+			}
+			memcpy(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+			header->version = 1;
+			header->numChannels = numChannels;
+			header->sampleRate = srate;
+			header->dataEnd = 0;
+			header->indexOffset = 0;
+			header->numRecords = 0;
+			header->numSamples = 0;
+
+			startThread();
+		}
+
+		/*
+		* Writes the index, finalises the header and trims the unused tail of the last segment
+		*/
+		~CaptureWriter() {
+			signalThreadShouldExit();
+			notify();
+			stopThread(5000);
+			retiredMap = nullptr;
+			nextMap = nullptr;
+
+			if (getHeader() == nullptr) {
+				return;
+			}
+
+			// The records are contiguous, so the index is rebuilt from their headers here rather
+			// than kept in memory while capturing
+			std::vector<int64> index;
+			const uint8* data = (const uint8*)map->getData();
+			for (int64 pos = sizeof(CaptureHeader); pos < writePos;
+				pos += captureRecordSize((const CaptureRecord*)(data + pos), numChannels)) {
+				index.push_back(pos);
+			}
+
+			int64 dataEnd = writePos;
+			int64 indexBytes = index.size() * sizeof(int64);
+			if (writePos + indexBytes > mappedSize) {
+				map = nullptr;
+				map = mapFile(writePos + indexBytes);
+				mappedSize = isOpen() ? (int64)map->getSize() : 0;
+				if (!isOpen()) {
+					return;
+				}
+			}
+			memcpy((uint8*)map->getData() + writePos, index.data(), indexBytes);
+			writePos += indexBytes;
+
+			CaptureHeader* header = getHeader();
+			header->dataEnd = dataEnd;
+			header->indexOffset = dataEnd;
+			header->numRecords = index.size();
+			header->numSamples = numSamples;
+
+			map = nullptr;
+			FileOutputStream out(file);
+			if (out.openedOk()) {
+				out.setPosition(writePos);
+				out.truncate();
+			}
+
+			if (dropped > 0) {
+				std::cout << "LSL capture dropped " << dropped << " records, the file could not grow fast enough" << std::endl;
+			}
+		}
+
+		bool isOpen() const {
+			return map != nullptr && map->getData() != nullptr;
+		}
+
+		/*
+		* Append a chunk exactly as pulled (multiplexed, nSamps x numChannels) with its timestamps
+		*/
+		void writeChunk(const float* data, const double* ts, int nSamps) {
+			CaptureRecord rec = { CAPTURE_DATA, (uint32)nSamps, ts[0] };
+			uint8* dest = beginRecord(rec);
+			if (dest == nullptr) {
+				return;
+			}
+			memcpy(dest, ts, nSamps * sizeof(double));
+			memcpy(dest + nSamps * sizeof(double), data, nSamps * numChannels * sizeof(float));
+			numSamples += nSamps;
+		}
+
+		void writeMarker(const std::string& text, double ts) {
+			CaptureRecord rec = { CAPTURE_MARKER, (uint32)text.size(), ts };
+			uint8* dest = beginRecord(rec);
+			if (dest == nullptr) {
+				return;
+			}
+			memcpy(dest, text.data(), text.size());
+		}
+
+		/*
+		* Grow the file a segment past the write position and map it again, then release the
+		* mapping the acquisition thread stopped using
+		*/
+		void run() override {
+			while (!threadShouldExit()) {
+				ScopedPointer<MemoryMappedFile> old;
+				int64 wanted;
+				{
+					const SpinLock::ScopedLockType lock(mapLock);
+					old = retiredMap.release();
+					wanted = nextMap == nullptr ? requested.load() : 0;
+				}
+				old = nullptr;
+
+				if (wanted > nextSize) {
+					ScopedPointer<MemoryMappedFile> grown = mapFile(wanted);
+					if (grown != nullptr && grown->getData() != nullptr) {
+						const SpinLock::ScopedLockType lock(mapLock);
+						nextSize = (int64)grown->getSize();
+						nextMap = grown.release();
+					}
+				}
+				wait(-1);
+			}
+		}
+
+	private:
+		CaptureHeader* getHeader() const {
+			return isOpen() ? (CaptureHeader*)map->getData() : nullptr;
+		}
+
+		uint8* beginRecord(const CaptureRecord& rec) {
+			uint8* dest = reserve(captureRecordSize(&rec, numChannels));
+			if (dest == nullptr) {
+				return nullptr;
+			}
+			memcpy(dest, &rec, sizeof(CaptureRecord));
+
+			// Keep the header usable if we never get to close the file
+			getHeader()->dataEnd = writePos;
+			return dest + sizeof(CaptureRecord);
+		}
+
+		/*
+		* Room for bytes at the write position. Never waits: a record that does not fit before the
+		* writer thread has grown the file is dropped and counted.
+		*/
+		uint8* reserve(int64 bytes) {
+			if (!isOpen()) {
+				return nullptr;
+			}
+			if (writePos + bytes > mappedSize - CAPTURE_SEGMENT / 2) {
+				bool wake = false;
+				{
+					// Both mappings show the same file, so nothing written so far is lost by switching
+					const SpinLock::ScopedLockType lock(mapLock);
+					if (nextMap != nullptr && retiredMap == nullptr && nextSize >= writePos + bytes) {
+						retiredMap = map.release();
+						map = nextMap.release();
+						mappedSize = nextSize;
+						wake = true;
+					}
+				}
+				if (requested.load() < mappedSize + CAPTURE_SEGMENT) {
+					requested = mappedSize + CAPTURE_SEGMENT;
+					wake = true;
+				}
+				if (wake) {
+					notify();
+				}
+			}
+			if (writePos + bytes > mappedSize) {
+				dropped++;
+				return nullptr;
+			}
+			uint8* dest = (uint8*)map->getData() + writePos;
+			writePos += bytes;
+			return dest;
+		}
+
+		// Extend the file to newSize and map all of it
+		MemoryMappedFile* mapFile(int64 newSize) {
+			{
+				FileOutputStream out(file);
+				if (out.failedToOpen()) {
+					return nullptr;
+				}
+				if (out.getPosition() < newSize) {
+					out.setPosition(newSize - 1);
+					out.writeByte(0);
+				}
+			}
+			return new MemoryMappedFile(file, MemoryMappedFile::readWrite);
+		}
+
+		File file;
+		ScopedPointer<MemoryMappedFile> map;
+		int64 mappedSize;
+		int64 writePos;
+		int numChannels;
+		int64 numSamples;
+
+		// Handed between the acquisition thread and the writer thread under mapLock
+		SpinLock mapLock;
+		ScopedPointer<MemoryMappedFile> nextMap;
+		ScopedPointer<MemoryMappedFile> retiredMap;
+		int64 nextSize;
+		std::atomic<int64> requested;
+		std::atomic<int64> dropped;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CaptureWriter);
+	};
+
+	/*
+	Plays a capture back through the same interface as LSLinletStream::pullChunk
+	*/
+	class CaptureReplay : public ReplaySource
+	{
+	public:
+		/*
+		* @param f capture file
+		* @param speedIn playback speed relative to the recorded timestamps, 0 for as fast as possible
+		*/
+		CaptureReplay(const File& f, float speed) :
+			ReplaySource(f),
+			map(f, MemoryMappedFile::readOnly),
+			pacer(speed)
+		{
+			base = (const uint8*)map.getData();
+			size = (int64)map.getSize();
+			if (base == nullptr || size < (int64)sizeof(CaptureHeader)) {
+				return;
+			}
+			const CaptureHeader* header = (const CaptureHeader*)base;
+			if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0
+				|| header->numChannels <= 0 || header->numChannels > CAPTURE_MAX_CHANNELS || !(header->sampleRate >= 0)) {
+				return;
+			}
+			numChannels = header->numChannels;
+			sampleRate = header->sampleRate;
+			dataEnd = jlimit((int64)sizeof(CaptureHeader), size, header->dataEnd);
+
+			// Take the stored index only if every entry is a record inside the data; otherwise, or
+			// if the capture was not closed cleanly, walk the records instead
+			const int64 indexOffset = header->indexOffset;
+			const int64 numRecords = header->numRecords;
+			if (indexOffset >= (int64)sizeof(CaptureHeader) && indexOffset <= size && indexOffset % sizeof(int64) == 0
+				&& numRecords >= 0 && numRecords <= (size - indexOffset) / (int64)sizeof(int64)) {
+				dataEnd = jmin(dataEnd, indexOffset);
+				const int64* stored = (const int64*)(base + indexOffset);
+				index.assign(stored, stored + numRecords);
+				for (size_t i = 0; i < index.size(); i++) {
+					if (!validRecord(index[i]) || (i > 0 && index[i] <= index[i - 1])) {
+						index.clear();
+						break;
+					}
+				}
+			}
+			if (index.empty()) {
+				int64 pos = sizeof(CaptureHeader);
+				while (validRecord(pos)) {
+					index.push_back(pos);
+					pos += captureRecordSize(record(index.size() - 1), numChannels);
+				}
+			}
+
+			restart();
+			success = true;
+		}
+
+		void restart() override {
+			nextRecord = startRecord;
+			recordPos = 0;
+			pacer.restart();
+			initTs = -1;
+		}
+
+		bool seek(double seconds) override {
+			// First data record that starts at or after the requested offset
+			double target = -1;
+			for (size_t i = 0; i < index.size(); i++) {
+				const CaptureRecord* rec = record(i);
+				if (rec->type != CAPTURE_DATA) {
+					continue;
+				}
+				if (target < 0) {
+					target = rec->timestamp + seconds;
+				}
+				if (rec->timestamp >= target) {
+					startRecord = i;
+					restart();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) override {
+			eventStr->clear();
+			eventInd->clear();
+
+			// Skip to the next data record, markers ahead of any data have nothing to land on
+			while (nextRecord < index.size() && record(nextRecord)->type != CAPTURE_DATA) {
+				nextRecord++;
+			}
+			if (nextRecord >= index.size()) {
+				Thread::sleep(int(timeout * 1000));
+				return 0;
+			}
+
+			const CaptureRecord* rec = record(nextRecord);
+			const double* recTs = (const double*)(rec + 1);
+			const float* recData = (const float*)(recTs + rec->count);
+
+			if (!pacer.waitFor(recTs[recordPos], timeout)) {
+				return 0;
+			}
+
+			int nPulled = jmin(maxSamps, int(rec->count) - recordPos);
+			memcpy(tsBuf, recTs + recordPos, nPulled * sizeof(double));
+			memcpy(dataBuf, recData + recordPos * numChannels, nPulled * numChannels * sizeof(float));
+			recordPos += nPulled;
+
+			if (recordPos == rec->count) {
+				nextRecord++;
+				recordPos = 0;
+
+				// Markers were written right after the chunk they arrived with
+				while (nextRecord < index.size() && record(nextRecord)->type == CAPTURE_MARKER) {
+					const CaptureRecord* marker = record(nextRecord++);
+					int ind = 0;
+					while (ind < nPulled - 1 && tsBuf[ind] < marker->timestamp) {
+						ind++;
+					}
+					eventStr->push_back(std::string((const char*)(marker + 1), marker->count));
+					eventInd->push_back(ind);
+				}
+			}
+
+			if (initTs == -1) {
+				initTs = tsBuf[0];
+			}
+			for (int i = 0; i < nPulled; i++) {
+				tsBuf[i] -= initTs;
+			}
+
+			return nPulled;
+		}
+
+	private:
+		const CaptureRecord* record(size_t i) const {
+			return (const CaptureRecord*)(base + index[i]);
+		}
+
+		// A known record type at an aligned offset, ending before dataEnd
+		bool validRecord(int64 pos) const {
+			if (pos < (int64)sizeof(CaptureHeader) || pos % 8 != 0 || pos + (int64)sizeof(CaptureRecord) > dataEnd) {
+				return false;
+			}
+			const CaptureRecord* rec = (const CaptureRecord*)(base + pos);
+			return (rec->type == CAPTURE_DATA || rec->type == CAPTURE_MARKER)
+				&& (rec->type == CAPTURE_MARKER || rec->count > 0)
+				&& captureRecordSize(rec, numChannels) <= dataEnd - pos;
+		}
+
+		MemoryMappedFile map;
+		const uint8* base;
+		int64 size;
+		int64 dataEnd;
+		std::vector<int64> index;
+
+		ReplayPacer pacer;
+		size_t startRecord = 0;
+		size_t nextRecord;
+		int recordPos;
+		double initTs;
+
+		JUCE_LEAK_DETECTOR(CaptureReplay);
+	};
+}
+
+#endif // OEP_LSL_CAPTURE_H_INCLUDED
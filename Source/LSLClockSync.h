@@ -0,0 +1,286 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Clock offset estimation
+
+
+time_correction() returns the offset to add to a remote timestamp to get local_clock() time,
+measured by a round trip to the outlet. A single probe is noisy, and the offset drifts when
+the two hosts' oscillators run at slightly different rates. This service probes every inlet
+periodically, throws away probes whose round trip (uncertainty) is well above the typical one,
+and fits offset + drift * (t - t0) through the rest with a Theil-Sen estimator, which ignores
+outliers that made it past the uncertainty check.
+
+The service holds shared handles to the inlets it probes. An inlet reopened while it runs is
+handed over with replaceInlet(), which does not wait for a probe in progress.
+*/
+
+#ifndef OEP_LSL_CLOCK_SYNC_H_INCLUDED
+#define OEP_LSL_CLOCK_SYNC_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+
+namespace LSLinletNode
+{
+	const double DEFAULT_CLOCK_INTERVAL = 5.0;
+	const double DEFAULT_CLOCK_MAX_UNCERTAINTY = 0.01;
+	const int CLOCK_WINDOW = 60;
+
+	/*
+	Shared handle of an inlet. A thread that probes an inlet holds one, so the inlet stays alive
+	for as long as that thread uses it even when acquisition replaces or closes it.
+	*/
+	typedef std::shared_ptr<lsl_inlet_struct_> InletHandle;
+
+	/*
+	Maps remote timestamps of one inlet into the local clock domain
+	*/
+	struct ClockModel
+	{
+		double offset = 0;
+		double drift = 0;
+		double t0 = 0;
+		double uncertainty = 0;
+		bool valid = false;
+
+		double map(double remoteTs) const {
+			return remoteTs + offset + drift * (remoteTs - t0);
+		}
+
+		void apply(double* ts, int n) const {
+			if (!valid) {
+				return;
+			}
+			const double a = 1.0 + drift;
+			const double b = offset - drift * t0;
+			for (int i = 0; i < n; i++) {
+				ts[i] = a * ts[i] + b;
+			}
+		}
+	};
+
+	class ClockSync : public Thread
+	{
+	public:
+		ClockSync() : Thread("LSL Clock Sync"),
+			interval(DEFAULT_CLOCK_INTERVAL),
+			maxUncertainty(DEFAULT_CLOCK_MAX_UNCERTAINTY)
+		{
+		}
+
+		~ClockSync() {
+			stopThread(3000);
+		}
+
+		/*
+		* Register an inlet to probe; must be called before startThread()
+		* @return id to query the model with
+		*/
+		int addInlet(InletHandle inlet) {
+			jassert(!isThreadRunning());
+			const SpinLock::ScopedLockType lock(modelLock);
+			inlets.push_back(Tracked());
+			inlets.back().inlet = inlet;
+			return (int)inlets.size() - 1;
+		}
+
+		void clearInlets() {
+			jassert(!isThreadRunning());
+			const SpinLock::ScopedLockType lock(modelLock);
+			inlets.clear();
+		}
+
+		/*
+		* Probe a reopened inlet from now on, without stopping the thread. Its probes start over and
+		* the next one is taken right away; the old inlet is let go of on this thread.
+		* @param keepModel true if the new outlet runs on the same clock, so the current model
+		*                  still applies until the new probes replace it
+		*/
+		void replaceInlet(int id, InletHandle inlet, bool keepModel) {
+			{
+				const SpinLock::ScopedLockType lock(modelLock);
+				inlets[id].next = inlet;
+				inlets[id].generation++;
+				if (!keepModel) {
+					inlets[id].model = ClockModel();
+				}
+			}
+			notify();
+		}
+
+		ClockModel getModel(int id) const {
+			const SpinLock::ScopedLockType lock(modelLock);
+			return inlets[id].model;
+		}
+
+		/*
+		* Map a chunk of remote timestamps in place
+		*/
+		void apply(int id, double* ts, int n) const {
+			getModel(id).apply(ts, n);
+		}
+
+		double map(int id, double ts) const {
+			return getModel(id).map(ts);
+		}
+
+		void run() override {
+			while (!threadShouldExit()) {
+				for (size_t i = 0; i < inlets.size() && !threadShouldExit(); i++) {
+					probe(inlets[i]);
+				}
+				wait(int(interval * 1000));
+			}
+		}
+
+		double interval;
+		double maxUncertainty;
+
+	private:
+		struct Probe
+		{
+			double remote;
+			double offset;
+			double uncertainty;
+		};
+
+		struct Tracked
+		{
+			InletHandle inlet;
+			InletHandle next;
+			int generation = 0;
+			int probedGeneration = 0;
+			std::deque<Probe> probes;
+			ClockModel model;
+		};
+
+		// inlet, probedGeneration and probes belong to this thread; the rest is under modelLock
+		void probe(Tracked& tracked) {
+			InletHandle retired;
+			int generation;
+			{
+				const SpinLock::ScopedLockType lock(modelLock);
+				generation = tracked.generation;
+				if (tracked.next != nullptr) {
+					retired = tracked.inlet;
+					tracked.inlet = tracked.next;
+					tracked.next = nullptr;
+				}
+			}
+			if (generation != tracked.probedGeneration) {
+				tracked.probes.clear();
+				tracked.probedGeneration = generation;
+			}
+
+			Probe p;
+			int32_t ec = 0;
+			p.offset = lsl_time_correction_ex(tracked.inlet.get(), &p.remote, &p.uncertainty, 2.0, &ec);
+			if (ec != 0 || p.uncertainty > maxUncertainty) {
+				return;
+			}
+			tracked.probes.push_back(p);
+			if (tracked.probes.size() > CLOCK_WINDOW) {
+				tracked.probes.pop_front();
+			}
+
+			ClockModel model = fit(tracked.probes);
+			const SpinLock::ScopedLockType lock(modelLock);
+			if (tracked.generation == generation) {
+				tracked.model = model;
+			}
+		}
+
+		static double median(std::vector<double>& v) {
+			size_t mid = v.size() / 2;
+			std::nth_element(v.begin(), v.begin() + mid, v.end());
+			return v[mid];
+		}
+
+		ClockModel fit(const std::deque<Probe>& all) const {
+			ClockModel model;
+			if (all.empty()) {
+				return model;
+			}
+
+			// Drop probes with more than twice the typical round trip
+			std::vector<double> values;
+			for (const Probe& p : all) {
+				values.push_back(p.uncertainty);
+			}
+			double limit = 2.0 * median(values);
+
+			std::vector<Probe> probes;
+			for (const Probe& p : all) {
+				if (p.uncertainty <= limit) {
+					probes.push_back(p);
+				}
+			}
+
+			model.t0 = probes.back().remote;
+
+			// Theil-Sen: drift is the median of all pairwise slopes
+			values.clear();
+			for (size_t i = 0; i < probes.size(); i++) {
+				for (size_t j = i + 1; j < probes.size(); j++) {
+					double dt = probes[j].remote - probes[i].remote;
+					if (dt > 0) {
+						values.push_back((probes[j].offset - probes[i].offset) / dt);
+					}
+				}
+			}
+			model.drift = values.empty() ? 0.0 : median(values);
+
+			values.clear();
+			for (const Probe& p : probes) {
+				values.push_back(p.offset - model.drift * (p.remote - model.t0));
+			}
+			model.offset = median(values);
+
+			// Spread of the probes around the fit, or half the round trip if that is larger
+			values.clear();
+			std::vector<double> roundTrips;
+			for (const Probe& p : probes) {
+				values.push_back(std::abs(p.offset - model.drift * (p.remote - model.t0) - model.offset));
+				roundTrips.push_back(p.uncertainty);
+			}
+			model.uncertainty = jmax(1.4826 * median(values), 0.5 * median(roundTrips));
+			model.valid = true;
+
+			return model;
+		}
+
+		// Only resized while the thread is stopped
+		std::vector<Tracked> inlets;
+		SpinLock modelLock;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ClockSync);
+	};
+}
+
+#endif // OEP_LSL_CLOCK_SYNC_H_INCLUDED
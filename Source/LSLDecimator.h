@@ -0,0 +1,210 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Multichannel decimator
+
+
+Reduces the rate by an integer factor, e.g. 30 kHz -> 1 kHz for LFP. The factor is split into
+its prime factors and each becomes one stage (30 = 5 x 3 x 2), largest first, so most of the
+rate reduction happens early and the later stages run at the low rates. Every stage is a
+windowed-sinc anti-alias lowpass that is only evaluated at the samples it keeps, which is the
+polyphase form of a decimating FIR. The filters are linear phase and delay the data by delay()
+input samples; events placed on the output have to be moved by as much to stay on their response.
+
+As in the resampler, data is multiplexed and the inner loop runs over contiguous channels so
+the compiler vectorizes it.
+*/
+
+#ifndef OEP_LSL_DECIMATOR_H_INCLUDED
+#define OEP_LSL_DECIMATOR_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <cmath>
+
+namespace LSLinletNode
+{
+	const int DECIMATOR_TAPS_PER_FACTOR = 16;   // stage filter length per unit of its factor
+	const double DECIMATOR_PASSBAND = 0.8;      // cutoff as a fraction of the stage's output Nyquist
+
+	class Decimator
+	{
+	public:
+		Decimator() : numChans(0), total(1) {}
+
+		/*
+		* @param nChans channels of the multiplexed data
+		* @param factor total decimation factor, 1 turns the decimator off
+		*/
+		void configure(int nChans, int factor) {
+			numChans = nChans;
+			total = jmax(1, factor);
+			stages.clear();
+
+			int rest = total;
+			std::vector<int> factors;
+			for (int p = 2; p <= rest; p++) {
+				while (rest % p == 0) {
+					factors.push_back(p);
+					rest /= p;
+				}
+			}
+			for (int s = (int)factors.size() - 1; s >= 0; s--) {
+				stages.push_back(Stage());
+				stages.back().design(factors[s], numChans);
+			}
+			reset();
+		}
+
+		void reset() {
+			for (Stage& stage : stages) {
+				std::fill(stage.history.begin(), stage.history.end(), 0.0f);
+				stage.skip = 0;
+			}
+		}
+
+		int factor() const {
+			return total;
+		}
+
+		/*
+		* Filter delay, in input samples
+		*/
+		double delay() const {
+			double d = 0;
+			int rate = 1;
+			for (const Stage& stage : stages) {
+				d += rate * (stage.taps.size() - 1) / 2.0;
+				rate *= stage.factor;
+			}
+			return d;
+		}
+
+		/*
+		* Index in this chunk of the input sample the first output is taken at; input i maps
+		* to output (i - firstInput() + factor() - 1) / factor()
+		*/
+		int firstInput() const {
+			// Each stage keeps the input skip samples in; walk back from the last stage
+			int first = 0;
+			for (int s = (int)stages.size() - 1; s >= 0; s--) {
+				first = stages[s].skip + first * stages[s].factor;
+			}
+			return first;
+		}
+
+		/*
+		* Decimate a chunk; in and out may be the same buffer
+		* @return number of output samples written, about nIn / factor()
+		*/
+		int process(const float* in, int nIn, float* out) {
+			if (stages.empty()) {
+				if (out != in) {
+					memcpy(out, in, nIn * numChans * sizeof(float));
+				}
+				return nIn;
+			}
+			int n = nIn;
+			const float* src = in;
+			for (Stage& stage : stages) {
+				n = stage.process(src, n, out, numChans);
+				src = out;
+			}
+			return n;
+		}
+
+	private:
+		struct Stage
+		{
+			int factor;
+			int skip;      // input samples to skip before the next kept one
+			std::vector<float> taps;
+			std::vector<float> history;
+			std::vector<float> work;
+
+			/*
+			* Blackman windowed sinc, reversed so the loop walks forwards in time, unity DC gain
+			*/
+			void design(int factorIn, int nChans) {
+				factor = factorIn;
+				skip = 0;
+				const int n = DECIMATOR_TAPS_PER_FACTOR * factor + 1;
+				const double cutoff = 0.5 * DECIMATOR_PASSBAND / factor;
+				const double centre = (n - 1) / 2.0;
+
+				std::vector<double> proto(n);
+				double gain = 0;
+				for (int k = 0; k < n; k++) {
+					double x = k - centre;
+					double sinc = x == 0 ? 2.0 * cutoff : std::sin(2.0 * double_Pi * cutoff * x) / (double_Pi * x);
+					double blackman = 0.42 - 0.5 * std::cos(2.0 * double_Pi * k / (n - 1)) + 0.08 * std::cos(4.0 * double_Pi * k / (n - 1));
+					proto[k] = sinc * blackman;
+					gain += proto[k];
+				}
+				taps.resize(n);
+				for (int k = 0; k < n; k++) {
+					taps[n - 1 - k] = float(proto[k] / gain);
+				}
+				history.assign((n - 1) * nChans, 0.0f);
+			}
+
+			int process(const float* in, int nIn, float* out, int numChans) {
+				// work = history followed by this chunk, which also makes in-place use safe
+				const int hist = (int)taps.size() - 1;
+				work.resize((hist + nIn) * numChans);
+				std::copy(history.begin(), history.end(), work.begin());
+				std::copy(in, in + nIn * numChans, work.begin() + hist * numChans);
+
+				int nOut = 0;
+				int i = skip;
+				for (; i < nIn; i += factor) {
+					const float* oldest = &work[i * numChans];
+					float* dest = out + nOut * numChans;
+					for (int ch = 0; ch < numChans; ch++) {
+						dest[ch] = 0.0f;
+					}
+					for (int t = 0; t <= hist; t++) {
+						const float c = taps[t];
+						const float* x = oldest + t * numChans;
+						for (int ch = 0; ch < numChans; ch++) {
+							dest[ch] += c * x[ch];
+						}
+					}
+					nOut++;
+				}
+				skip = i - nIn;
+
+				std::copy(work.end() - hist * numChans, work.end(), history.begin());
+				return nOut;
+			}
+		};
+
+		int numChans;
+		int total;
+		std::vector<Stage> stages;
+
+		JUCE_LEAK_DETECTOR(Decimator);
+	};
+}
+
+#endif // OEP_LSL_DECIMATOR_H_INCLUDED
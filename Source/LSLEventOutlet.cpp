@@ -0,0 +1,203 @@
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "LSLEventOutlet.h"
+#include "LSLEventOutletEditor.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace LSLOutletNode;
+
+// Weight of each new block when smoothing the sample to clock offset
+const double CLOCK_SMOOTHING = 0.01;
+
+// How often run() looks for queued markers; enqueue() never signals the thread, since
+// notify() takes a lock on the processing thread
+const int QUEUE_POLL_MS = 5;
+
+LSLEventOutlet::LSLEventOutlet() : GenericProcessor("LSL Event Outlet"), Thread("LSL Event Outlet"),
+    stream_name("OpenEphysMarkers"),
+    fifo(EVENT_QUEUE_SIZE)
+{
+    setProcessorType(PROCESSOR_TYPE_SINK);
+}
+
+LSLEventOutlet::~LSLEventOutlet()
+{
+    stopThread(1000);
+}
+
+AudioProcessorEditor* LSLEventOutlet::createEditor()
+{
+    editor = new LSLEventOutletEditor(this, this);
+    return editor;
+}
+
+bool LSLEventOutlet::enable()
+{
+    lsl::stream_info info(stream_name.toStdString(), "Markers", 1, lsl::IRREGULAR_RATE,
+        lsl::cf_string, "openephys-events-" + String(getNodeId()).toStdString());
+    outlet = new lsl::stream_outlet(info);
+
+    fifo.reset();
+
+    // Events carry sample numbers of their own subprocessor, which can differ in rate and start
+    clocks.clear();
+    for (int ch = 0; ch < getTotalDataChannels(); ch++)
+    {
+        const DataChannel* chan = getDataChannel(ch);
+        bool known = false;
+        for (const SubprocessorClock& clock : clocks)
+            known = known || (clock.sourceNode == chan->getSourceNodeID() && clock.subProcessor == chan->getSubProcessorIdx());
+        if (!known)
+        {
+            SubprocessorClock clock = { chan->getSourceNodeID(), chan->getSubProcessorIdx(), ch, chan->getSampleRate(), 0.0, false };
+            clocks.push_back(clock);
+        }
+    }
+
+    statBlocks = 0;
+    statJitterSum = 0;
+    statJitterMax = 0;
+    statMarkers = 0;
+    statDropped = 0;
+
+    startThread();
+    return true;
+}
+
+bool LSLEventOutlet::disable()
+{
+    // run() drains the queue before returning
+    signalThreadShouldExit();
+    notify();
+    stopThread(1000);
+
+    if (statBlocks > 0)
+    {
+        std::cout << "LSL event outlet markers: " << statMarkers
+            << ", dropped: " << statDropped
+            << ", block timing jitter mean: " << statJitterSum / statBlocks * 1000.0 << " ms"
+            << ", max: " << statJitterMax * 1000.0 << " ms" << std::endl;
+    }
+
+    outlet = nullptr;
+    return true;
+}
+
+double LSLEventOutlet::sampleToClock(const SubprocessorClock& clock, int64 sampleNumber)
+{
+    return clock.offset + sampleNumber / clock.sampleRate;
+}
+
+const SubprocessorClock* LSLEventOutlet::clockFor(const EventChannel* eventInfo) const
+{
+    for (const SubprocessorClock& clock : clocks)
+    {
+        if (clock.sourceNode == eventInfo->getSourceNodeID() && clock.subProcessor == eventInfo->getSubProcessorIdx())
+            return &clock;
+    }
+    return clocks.empty() ? nullptr : &clocks[0];
+}
+
+void LSLEventOutlet::process(AudioSampleBuffer& buffer)
+{
+    // The end of the block that was just handed to us was acquired at about "now". A single
+    // block is jittered by scheduling, so each subprocessor's offset is smoothed over many
+    // blocks. How far a block strays from the model is the jitter the smoothing removes, not
+    // the error of a marker's timestamp, which would need the source's own sample times.
+    const double now = lsl::local_clock();
+    for (SubprocessorClock& clock : clocks)
+    {
+        if (clock.sampleRate <= 0)
+            continue;
+
+        int64 blockEnd = getTimestamp(clock.channel) + getNumSamples(clock.channel);
+        double offset = now - blockEnd / clock.sampleRate;
+
+        if (!clock.valid)
+        {
+            clock.offset = offset;
+            clock.valid = true;
+        }
+        else
+        {
+            double jitter = std::abs(offset - clock.offset);
+            statJitterSum += jitter;
+            statJitterMax = jmax(statJitterMax, jitter);
+            statBlocks++;
+
+            clock.offset += CLOCK_SMOOTHING * (offset - clock.offset);
+        }
+    }
+
+    checkForEvents();
+}
+
+void LSLEventOutlet::handleEvent(const EventChannel* eventInfo, const MidiMessage& event, int samplePosition)
+{
+    const SubprocessorClock* clock = clockFor(eventInfo);
+    if (clock == nullptr || !clock->valid)
+        return;
+
+    if (eventInfo->getChannelType() == EventChannel::TTL)
+    {
+        TTLEventPtr ttl = TTLEvent::deserializeFromMessage(event, eventInfo);
+        int line = ttl->getChannel() + 1;
+        char text[16];
+        snprintf(text, sizeof(text), "%d", ttl->getState() ? line : -line);
+        enqueue(sampleToClock(*clock, ttl->getTimestamp()), text);
+    }
+    else if (eventInfo->getChannelType() == EventChannel::TEXT)
+    {
+        TextEventPtr text = TextEvent::deserializeFromMessage(event, eventInfo);
+        enqueue(sampleToClock(*clock, text->getTimestamp()), text->getText().toRawUTF8());
+    }
+}
+
+void LSLEventOutlet::enqueue(double timestamp, const char* text)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 == 0)
+    {
+        statDropped++;
+        return;
+    }
+
+    EventMarker& marker = queue[start1];
+    marker.timestamp = timestamp;
+    strncpy(marker.text, text, MAX_MARKER_LENGTH - 1);
+    marker.text[MAX_MARKER_LENGTH - 1] = 0;
+
+    fifo.finishedWrite(1);
+    statMarkers++;
+}
+
+void LSLEventOutlet::run()
+{
+    std::string text;
+
+    while (true)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+        for (int i = 0; i < size1 + size2; i++)
+        {
+            const EventMarker& marker = queue[i < size1 ? start1 + i : start2 + i - size1];
+            text.assign(marker.text);
+            outlet->push_sample(&text, marker.timestamp);
+        }
+
+        fifo.finishedRead(size1 + size2);
+
+        if (threadShouldExit() && fifo.getNumReady() == 0)
+            break;
+
+        wait(QUEUE_POLL_MS);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef __LSLEVENTOUTLETH__
+#define __LSLEVENTOUTLETH__
+
+#include <ProcessorHeaders.h>
+#include <lsl_cpp.h>
+#include <vector>
+
+const int EVENT_QUEUE_SIZE = 1024;
+const int MAX_MARKER_LENGTH = 128;
+
+namespace LSLOutletNode
+{
+    struct EventMarker
+    {
+        double timestamp;
+        char text[MAX_MARKER_LENGTH];
+    };
+
+    // Clock model of one subprocessor: local_clock() = offset + sample / sampleRate
+    struct SubprocessorClock
+    {
+        uint16 sourceNode;
+        uint16 subProcessor;
+        int channel;
+        float sampleRate;
+        double offset;
+        bool valid;
+    };
+
+    /*
+    Publishes TTL and text events as an LSL marker stream.
+    The processing thread only stamps and enqueues; a background thread owns the outlet
+    and polls the queue, so network pushes can never stall a block.
+
+    TTL rising edges are sent as the 1 based line number (what LSL Inlet turns back into
+    TTL words), falling edges as its negative, text events verbatim.
+    */
+    class LSLEventOutlet : public GenericProcessor, public Thread
+    {
+
+    public:
+        LSLEventOutlet();
+        ~LSLEventOutlet();
+
+        AudioProcessorEditor* createEditor() override;
+
+        void process(AudioSampleBuffer& buffer) override;
+        void handleEvent(const EventChannel* eventInfo, const MidiMessage& event, int samplePosition) override;
+        bool enable() override;
+        bool disable() override;
+
+        void run() override;
+
+        // User defined
+        String stream_name;
+
+    private:
+        // Clock of the subprocessor an event channel belongs to; the first one if it has no data channels
+        const SubprocessorClock* clockFor(const EventChannel* eventInfo) const;
+
+        // Maps a sample number of that subprocessor onto lsl::local_clock()
+        static double sampleToClock(const SubprocessorClock& clock, int64 sampleNumber);
+        void enqueue(double timestamp, const char* text);
+
+        ScopedPointer<lsl::stream_outlet> outlet;
+
+        // Single producer (processing thread), single consumer (run)
+        AbstractFifo fifo;
+        EventMarker queue[EVENT_QUEUE_SIZE];
+
+        // One clock per subprocessor with data channels, found when acquisition starts
+        std::vector<SubprocessorClock> clocks;
+
+        // How far each block's end strays from the smoothed clock model (scheduling jitter),
+        // printed when acquisition stops
+        int64 statBlocks;
+        double statJitterSum;
+        double statJitterMax;
+        int64 statMarkers;
+        int64 statDropped;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LSLEventOutlet);
+    };
+}
+#endif
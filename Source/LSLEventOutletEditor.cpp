@@ -0,0 +1,72 @@
+#include "LSLEventOutletEditor.h"
+#include "LSLEventOutlet.h"
+
+#include <string>
+#include <iostream>
+
+using namespace LSLOutletNode;
+
+LSLEventOutletEditor::LSLEventOutletEditor(GenericProcessor* parentNode, LSLEventOutlet* outlet) : GenericEditor(parentNode, false)
+{
+    node = outlet;
+
+    desiredWidth = 180;
+
+    // Stream name
+    nameLabel = new Label("NAME", "NAME");
+    nameLabel->setFont(Font("Small Text", 10, Font::plain));
+    nameLabel->setBounds(5, 30, 65, 8);
+    nameLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(nameLabel);
+
+    nameInput = new Label("Name", node->stream_name);
+    nameInput->setFont(Font("Small Text", 10, Font::plain));
+    nameInput->setBounds(10, 42, 160, 15);
+    nameInput->setEditable(true);
+    nameInput->setColour(Label::backgroundColourId, Colours::lightgrey);
+    nameInput->addListener(this);
+    addAndMakeVisible(nameInput);
+}
+
+void LSLEventOutletEditor::labelTextChanged(Label* label)
+{
+    if (label == nameInput)
+    {
+        if (nameInput->getText().isNotEmpty())
+        {
+            node->stream_name = nameInput->getText();
+        }
+        else {
+            nameInput->setText(node->stream_name, dontSendNotification);
+        }
+    }
+}
+
+void LSLEventOutletEditor::startAcquisition()
+{
+    nameInput->setEnabled(false);
+}
+
+void LSLEventOutletEditor::stopAcquisition()
+{
+    nameInput->setEnabled(true);
+}
+
+void LSLEventOutletEditor::saveCustomParameters(XmlElement* xmlNode)
+{
+    XmlElement* parameters = xmlNode->createNewChildElement("PARAMETERS");
+
+    parameters->setAttribute("name", nameInput->getText());
+}
+
+void LSLEventOutletEditor::loadCustomParameters(XmlElement* xmlNode)
+{
+    forEachXmlChildElement(*xmlNode, subNode)
+    {
+        if (subNode->hasTagName("PARAMETERS"))
+        {
+            node->stream_name = subNode->getStringAttribute("name", node->stream_name);
+            nameInput->setText(node->stream_name, dontSendNotification);
+        }
+    }
+}
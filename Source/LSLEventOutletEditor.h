@@ -0,0 +1,49 @@
+#ifndef __LSLEVENTOUTLETEDITORH__
+#define __LSLEVENTOUTLETEDITORH__
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <EditorHeaders.h>
+
+namespace LSLOutletNode
+{
+    class LSLEventOutlet;
+
+    class LSLEventOutletEditor : public GenericEditor, public Label::Listener
+    {
+
+    public:
+
+        LSLEventOutletEditor(GenericProcessor* parentNode, LSLEventOutlet *node);
+
+        /** Called by processor graph in beginning of the acqusition, disables editor completly. */
+        void startAcquisition();
+
+        /** Called by processor graph at the end of the acqusition, reenables editor completly. */
+        void stopAcquisition();
+
+        /** Called when configuration is saved. Adds editors config to xml. */
+        void saveCustomParameters(XmlElement* xml) override;
+
+        /** Called when configuration is loaded. Reads editors config from xml. */
+        void loadCustomParameters(XmlElement* xml) override;
+
+        /** Called when label is changed */
+        void labelTextChanged(Label* label);
+
+    private:
+
+        // Stream name
+        ScopedPointer<Label> nameLabel;
+        ScopedPointer<Label> nameInput;
+
+        // Parent node
+        LSLEventOutlet* node;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LSLEventOutletEditor);
+    };
+}
+
+#endif
@@ -0,0 +1,275 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Fused ingest filter
+
+
+Scales every channel, re-references, removes DC with a one-pole highpass and takes out line
+noise with a biquad notch, all in the pass that converts the received chunk, so each sample
+is touched once while it is in cache instead of once per downstream filter.
+
+    reference   subtract the mean of the referenced channels, of the channel's group, or one channel
+    DC blocker  y[n] = x[n] - x[n-1] + R y[n-1],   R = exp(-2 pi fc / fs)
+    notch       RBJ biquad, transposed direct form II
+
+Filter state is stored per stage as one array over channels (structure of arrays), and the
+data is multiplexed, so for each sample the loop over channels reads and writes contiguous
+memory with no dependency between channels and the compiler vectorizes it. Re-referencing
+needs the whole scaled sample first, so each sample is scaled, referenced and then filtered
+while its row is still in L1.
+*/
+
+#ifndef OEP_LSL_INGEST_FILTER_H_INCLUDED
+#define OEP_LSL_INGEST_FILTER_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <cmath>
+#include <vector>
+
+namespace LSLinletNode
+{
+	const double DEFAULT_NOTCH_Q = 30.0;
+
+	enum ReferenceMode
+	{
+		REF_NONE = 0,
+		REF_COMMON_AVERAGE = 1,
+		REF_CHANNEL = 2,
+		REF_GROUPS = 3
+	};
+
+	class IngestFilter
+	{
+	public:
+		IngestFilter() : numChans(0), refMode(REF_NONE), refChannel(0), refChans(0), numGroups(0), dcOn(false), notchOn(false), R(0), b0(1), b1(0), b2(1), a1(0), a2(0) {}
+
+		/*
+		* @param nChans channels of the multiplexed data
+		* @param srate rate of the data
+		* @param scale gain applied to every channel
+		* @param channelGains extra per-channel gains, missing channels get 1
+		* @param dcCutoff DC blocker corner in Hz, 0 for none
+		* @param notchFreq notch centre in Hz (50 or 60), 0 for none
+		* @param notchQ notch quality factor
+		*/
+		void configure(int nChans, double srate, float scale, const Array<float>& channelGains,
+			double dcCutoff, double notchFreq, double notchQ) {
+			numChans = nChans;
+			gain.resize(numChans);
+			unity.assign(numChans, 1.0f);
+			for (int ch = 0; ch < numChans; ch++) {
+				gain[ch] = scale * (ch < channelGains.size() ? channelGains[ch] : 1.0f);
+			}
+
+			dcOn = dcCutoff > 0 && srate > 0;
+			if (dcOn) {
+				R = float(std::exp(-2.0 * double_Pi * dcCutoff / srate));
+			}
+
+			notchOn = notchFreq > 0 && notchFreq < srate / 2;
+			if (notchOn) {
+				double w0 = 2.0 * double_Pi * notchFreq / srate;
+				double alpha = std::sin(w0) / (2.0 * (notchQ > 0 ? notchQ : DEFAULT_NOTCH_Q));
+				double a0 = 1.0 + alpha;
+				b0 = float(1.0 / a0);
+				b1 = float(-2.0 * std::cos(w0) / a0);
+				b2 = b0;
+				a1 = b1;
+				a2 = float((1.0 - alpha) / a0);
+			}
+
+			refMode = REF_NONE;
+			reset();
+		}
+
+		/*
+		* @param mode one of ReferenceMode
+		* @param channel reference channel for REF_CHANNEL, 0 based
+		* @param groups group of each channel for REF_GROUPS, -1 leaves a channel as it is
+		* @param nRef channels REF_COMMON_AVERAGE and REF_CHANNEL cover, the first ones; those after
+		*             them (auxiliary streams) are left as they are
+		*/
+		void setReference(int mode, int channel, const Array<int>& groups, int nRef) {
+			refMode = mode;
+			refChannel = channel;
+			refChans = jlimit(0, numChans, nRef);
+			if (refMode == REF_CHANNEL && (refChannel < 0 || refChannel >= refChans)) {
+				refMode = REF_NONE;
+			}
+			if (refMode == REF_COMMON_AVERAGE && refChans == 0) {
+				refMode = REF_NONE;
+			}
+
+			numGroups = 0;
+			group.assign(numChans, -1);
+			for (int ch = 0; ch < numChans && ch < groups.size(); ch++) {
+				group[ch] = groups[ch];
+				numGroups = jmax(numGroups, groups[ch] + 1);
+			}
+			groupSum.assign(numGroups, 0.0f);
+			groupScale.assign(numGroups, 0.0f);
+			for (int ch = 0; ch < numChans; ch++) {
+				if (group[ch] >= 0) {
+					groupScale[group[ch]] += 1.0f;
+				}
+			}
+			for (int g = 0; g < numGroups; g++) {
+				groupScale[g] = groupScale[g] > 0 ? 1.0f / groupScale[g] : 0.0f;
+			}
+			if (refMode == REF_GROUPS && numGroups == 0) {
+				refMode = REF_NONE;
+			}
+		}
+
+		void reset() {
+			dcX.assign(numChans, 0.0f);
+			dcY.assign(numChans, 0.0f);
+			z1.assign(numChans, 0.0f);
+			z2.assign(numChans, 0.0f);
+		}
+
+		/*
+		* Filter n multiplexed samples in place
+		*/
+		void process(float* data, int n) {
+			if (dcOn && notchOn) {
+				run<true, true>(data, n);
+			}
+			else if (dcOn) {
+				run<true, false>(data, n);
+			}
+			else if (notchOn) {
+				run<false, true>(data, n);
+			}
+			else {
+				run<false, false>(data, n);
+			}
+		}
+
+	private:
+		// Stages are template arguments so the channel loop has no branches in it
+		template <bool DC, bool NOTCH>
+		void run(float* data, int n) {
+			// Locals, so stores into the state arrays cannot alias the coefficients
+			const int nc = numChans;
+			const bool referenced = refMode != REF_NONE;
+			const float r = R, c0 = b0, c1 = b1, c2 = b2, d1 = a1, d2 = a2;
+
+			// With a reference the gain is applied before it, and the filter loop scales by 1
+			const float* g = gain.data();
+			const float* filterGain = referenced ? unity.data() : g;
+			float* px = dcX.data();
+			float* py = dcY.data();
+			float* s1 = z1.data();
+			float* s2 = z2.data();
+
+			for (int i = 0; i < n; i++) {
+				float* x = data + i * nc;
+				if (referenced) {
+					for (int ch = 0; ch < nc; ch++) {
+						x[ch] *= g[ch];
+					}
+					reference(x);
+				}
+				for (int ch = 0; ch < nc; ch++) {
+					float v = x[ch] * filterGain[ch];
+					if (DC) {
+						float y = v - px[ch] + r * py[ch];
+						px[ch] = v;
+						py[ch] = y;
+						v = y;
+					}
+					if (NOTCH) {
+						float y = c0 * v + s1[ch];
+						s1[ch] = c1 * v - d1 * y + s2[ch];
+						s2[ch] = c2 * v - d2 * y;
+						v = y;
+					}
+					x[ch] = v;
+				}
+			}
+		}
+
+		// Subtract the reference from one scaled sample
+		void reference(float* x) {
+			if (refMode == REF_COMMON_AVERAGE) {
+				float sum = 0.0f;
+				for (int ch = 0; ch < refChans; ch++) {
+					sum += x[ch];
+				}
+				const float mean = sum / refChans;
+				for (int ch = 0; ch < refChans; ch++) {
+					x[ch] -= mean;
+				}
+			}
+			else if (refMode == REF_CHANNEL) {
+				const float ref = x[refChannel];
+				for (int ch = 0; ch < refChans; ch++) {
+					x[ch] -= ref;
+				}
+			}
+			else {
+				std::fill(groupSum.begin(), groupSum.end(), 0.0f);
+				for (int ch = 0; ch < numChans; ch++) {
+					if (group[ch] >= 0) {
+						groupSum[group[ch]] += x[ch];
+					}
+				}
+				for (int g = 0; g < numGroups; g++) {
+					groupSum[g] *= groupScale[g];
+				}
+				for (int ch = 0; ch < numChans; ch++) {
+					if (group[ch] >= 0) {
+						x[ch] -= groupSum[group[ch]];
+					}
+				}
+			}
+		}
+
+		int numChans;
+		int refMode;
+		int refChannel;
+		int refChans;
+		int numGroups;
+		std::vector<int> group;
+		std::vector<float> groupSum;
+		std::vector<float> groupScale;
+		bool dcOn;
+		bool notchOn;
+		float R;
+		float b0, b1, b2, a1, a2;
+
+		// Per-channel gain and state, one array per quantity
+		std::vector<float> gain;
+		std::vector<float> unity;
+		std::vector<float> dcX;
+		std::vector<float> dcY;
+		std::vector<float> z1;
+		std::vector<float> z2;
+
+		JUCE_LEAK_DETECTOR(IngestFilter);
+	};
+}
+
+#endif // OEP_LSL_INGEST_FILTER_H_INCLUDED
@@ -19,6 +19,13 @@ LSLinletEditor::LSLinletEditor(GenericProcessor* parentNode, LSLinlet* socket) :
     connectButton->addListener(this);
     addAndMakeVisible(connectButton);
 
+    // Worst case memory held in the LSL inlets' buffers
+    inletBufferLabel = new Label("Inlet buffer", "");
+    inletBufferLabel->setFont(Font("Small Text", 10, Font::plain));
+    inletBufferLabel->setBounds(5, 60, 90, 15);
+    inletBufferLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(inletBufferLabel);
+
     //---
     bufferSizeMainLabel = new Label("BUFFER SIZE", "BUFFER SIZE");
     bufferSizeMainLabel->setFont(Font("Small Text", 12, Font::plain));
@@ -94,6 +101,37 @@ LSLinletEditor::LSLinletEditor(GenericProcessor* parentNode, LSLinlet* socket) :
     scaleInput->setColour(Label::backgroundColourId, Colours::lightgrey);
     scaleInput->addListener(this);
     addAndMakeVisible(scaleInput);
+
+    // Batching
+    batchSizeLabel = new Label("BATCH", "BATCH");
+    batchSizeLabel->setFont(Font("Small Text", 10, Font::plain));
+    batchSizeLabel->setBounds(145, 92, 45, 8);
+    batchSizeLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(batchSizeLabel);
+
+    batchSizeInput = new Label("Batch", String(node->batch_samples));
+    batchSizeInput->setFont(Font("Small Text", 10, Font::plain));
+    batchSizeInput->setBounds(150, 105, 35, 15);
+    batchSizeInput->setEditable(true);
+    batchSizeInput->setColour(Label::backgroundColourId, Colours::lightgrey);
+    batchSizeInput->addListener(this);
+    addAndMakeVisible(batchSizeInput);
+
+    batchDelayLabel = new Label("MAX MS", "MAX MS");
+    batchDelayLabel->setFont(Font("Small Text", 10, Font::plain));
+    batchDelayLabel->setBounds(190, 92, 45, 8);
+    batchDelayLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(batchDelayLabel);
+
+    batchDelayInput = new Label("Max ms", String(node->batch_delay_ms));
+    batchDelayInput->setFont(Font("Small Text", 10, Font::plain));
+    batchDelayInput->setBounds(195, 105, 35, 15);
+    batchDelayInput->setEditable(true);
+    batchDelayInput->setColour(Label::backgroundColourId, Colours::lightgrey);
+    batchDelayInput->addListener(this);
+    addAndMakeVisible(batchDelayInput);
+
+    updateInletFootprint();
 }
 
 void LSLinletEditor::labelTextChanged(Label* label)
@@ -155,6 +193,30 @@ void LSLinletEditor::labelTextChanged(Label* label)
             scaleInput->setText(String(node->data_scale), dontSendNotification);
         }
     }
+    else if (label == batchSizeInput)
+    {
+        int batchSize = batchSizeInput->getText().getIntValue();
+
+        if (batchSize >= 0 && batchSize < 100000)
+        {
+            node->batch_samples = batchSize;
+        }
+        else {
+            batchSizeInput->setText(String(node->batch_samples), dontSendNotification);
+        }
+    }
+    else if (label == batchDelayInput)
+    {
+        float batchDelay = batchDelayInput->getText().getFloatValue();
+
+        if (batchDelay >= 0.0f && batchDelay < 1000.0f)
+        {
+            node->batch_delay_ms = batchDelay;
+        }
+        else {
+            batchDelayInput->setText(String(node->batch_delay_ms), dontSendNotification);
+        }
+    }
 }
 
 void LSLinletEditor::startAcquisition()
@@ -164,6 +226,8 @@ void LSLinletEditor::startAcquisition()
     sampleRateInput->setEnabled(false);
     bufferSizeInput->setEnabled(false);
     scaleInput->setEnabled(false);
+    batchSizeInput->setEnabled(false);
+    batchDelayInput->setEnabled(false);
     connectButton->setEnabled(false);
 
     // Set the channels etc
@@ -179,6 +243,8 @@ void LSLinletEditor::stopAcquisition()
     sampleRateInput->setEnabled(true);
     bufferSizeInput->setEnabled(true);
     scaleInput->setEnabled(true);
+    batchSizeInput->setEnabled(true);
+    batchDelayInput->setEnabled(true);
     connectButton->setEnabled(true);
 }
 
@@ -188,6 +254,7 @@ void LSLinletEditor::buttonEvent(Button* button)
     if (button == connectButton)
     {
         node->tryToConnect();
+        updateInletFootprint();
     }
   
 }
@@ -200,6 +267,41 @@ void LSLinletEditor::saveCustomParameters(XmlElement* xmlNode)
     parameters->setAttribute("numsamp", bufferSizeInput->getText());
     parameters->setAttribute("fs", sampleRateInput->getText());
     parameters->setAttribute("scale", scaleInput->getText());
+    parameters->setAttribute("batchsamp", batchSizeInput->getText());
+    parameters->setAttribute("batchdelay", batchDelayInput->getText());
+    parameters->setAttribute("bufferseconds", node->buffer_seconds);
+    parameters->setAttribute("capturefile", node->capture_file);
+    parameters->setAttribute("replayfile", node->replay_file);
+    parameters->setAttribute("socketaddress", node->socket_address);
+    parameters->setAttribute("shmname", node->shm_name);
+    parameters->setAttribute("replayspeed", node->replay_speed);
+    parameters->setAttribute("replaystart", node->replay_start);
+    parameters->setAttribute("xdffile", node->xdf_file);
+    parameters->setAttribute("clockinterval", node->clock_interval);
+    parameters->setAttribute("clockmaxunc", node->clock_max_uncertainty_ms);
+    parameters->setAttribute("reorderms", node->reorder_ms);
+    parameters->setAttribute("reconnecttimeout", node->reconnect_timeout);
+    parameters->setAttribute("gapfill", node->gap_fill);
+    parameters->setAttribute("backupstream", node->backup_stream);
+    parameters->setAttribute("failoverms", node->failover_ms);
+    parameters->setAttribute("inletbuffers", node->inlet_buffer_s);
+    parameters->setAttribute("inletbuffermb", node->inlet_buffer_mb);
+    parameters->setAttribute("inletchunkms", node->inlet_chunk_ms);
+    parameters->setAttribute("overloadpolicy", node->overload_policy);
+    parameters->setAttribute("overloadms", node->overload_ms);
+    parameters->setAttribute("overloadlog", node->overload_log);
+    parameters->setAttribute("auxstreams", node->aux_streams);
+    parameters->setAttribute("irregularrate", node->irregular_rate);
+    parameters->setAttribute("irregularmode", node->irregular_mode);
+    parameters->setAttribute("decimation", node->decimation);
+    parameters->setAttribute("channelgains", node->channel_gains);
+    parameters->setAttribute("dccutoff", node->dc_cutoff);
+    parameters->setAttribute("notchfreq", node->notch_freq);
+    parameters->setAttribute("notchq", node->notch_q);
+    parameters->setAttribute("refmode", node->ref_mode);
+    parameters->setAttribute("refchannel", node->ref_channel);
+    parameters->setAttribute("refgroups", node->ref_groups);
+    parameters->setAttribute("triggerchannel", node->trigger_channel);
 }
 
 void LSLinletEditor::loadCustomParameters(XmlElement* xmlNode)
@@ -220,7 +322,90 @@ void LSLinletEditor::loadCustomParameters(XmlElement* xmlNode)
             scaleInput->setText(subNode->getStringAttribute("scale", ""), dontSendNotification);
             node->data_scale = subNode->getDoubleAttribute("scale", DEFAULT_DATA_SCALE);
 
+            batchSizeInput->setText(subNode->getStringAttribute("batchsamp", String(DEFAULT_BATCH_SAMPLES)), dontSendNotification);
+            node->batch_samples = subNode->getIntAttribute("batchsamp", DEFAULT_BATCH_SAMPLES);
+
+            batchDelayInput->setText(subNode->getStringAttribute("batchdelay", String(DEFAULT_BATCH_DELAY_MS)), dontSendNotification);
+            node->batch_delay_ms = subNode->getDoubleAttribute("batchdelay", DEFAULT_BATCH_DELAY_MS);
+            node->buffer_seconds = jmax(0.01, subNode->getDoubleAttribute("bufferseconds", DEFAULT_BUFFER_SECONDS));
+
+            node->capture_file = subNode->getStringAttribute("capturefile", "");
+            node->replay_file = subNode->getStringAttribute("replayfile", "");
+            node->replay_speed = subNode->getDoubleAttribute("replayspeed", DEFAULT_REPLAY_SPEED);
+            node->replay_start = subNode->getDoubleAttribute("replaystart", DEFAULT_REPLAY_START);
+            node->xdf_file = subNode->getStringAttribute("xdffile", "");
+
+            node->clock_interval = subNode->getDoubleAttribute("clockinterval", DEFAULT_CLOCK_INTERVAL);
+            node->clock_max_uncertainty_ms = subNode->getDoubleAttribute("clockmaxunc", DEFAULT_CLOCK_MAX_UNCERTAINTY * 1000.0);
+            node->applyClockSettings();
+
+            node->inlet_buffer_s = subNode->getDoubleAttribute("inletbuffers", DEFAULT_INLET_BUFFER_S);
+            node->inlet_buffer_mb = subNode->getDoubleAttribute("inletbuffermb", DEFAULT_INLET_BUFFER_MB);
+            node->inlet_chunk_ms = subNode->getDoubleAttribute("inletchunkms", DEFAULT_INLET_CHUNK_MS);
+            node->applyBufferSettings();
+
+            node->overload_policy = subNode->getIntAttribute("overloadpolicy", DEFAULT_OVERLOAD_POLICY);
+            node->overload_ms = subNode->getDoubleAttribute("overloadms", DEFAULT_OVERLOAD_MS);
+            node->overload_log = subNode->getStringAttribute("overloadlog", "");
+
+            node->reorder_ms = subNode->getDoubleAttribute("reorderms", DEFAULT_REORDER_MS);
+            node->reconnect_timeout = subNode->getDoubleAttribute("reconnecttimeout", DEFAULT_RECONNECT_TIMEOUT);
+            node->gap_fill = subNode->getIntAttribute("gapfill", DEFAULT_GAP_FILL);
+            node->backup_stream = subNode->getStringAttribute("backupstream", "");
+            node->failover_ms = subNode->getDoubleAttribute("failoverms", DEFAULT_FAILOVER_MS);
+            if (node->backup_stream.isNotEmpty())
+            {
+                node->openBackupStream();
+            }
+
+            node->irregular_rate = subNode->getDoubleAttribute("irregularrate", DEFAULT_GRID_RATE);
+            node->irregular_mode = subNode->getIntAttribute("irregularmode", DEFAULT_IRREGULAR_MODE);
+            node->applyGridSettings();
+
+            node->decimation = jmax(1, subNode->getIntAttribute("decimation", DEFAULT_DECIMATION));
+
+            node->channel_gains = subNode->getStringAttribute("channelgains", "");
+            node->dc_cutoff = subNode->getDoubleAttribute("dccutoff", DEFAULT_DC_CUTOFF);
+            node->notch_freq = subNode->getDoubleAttribute("notchfreq", DEFAULT_NOTCH_FREQ);
+            node->notch_q = subNode->getDoubleAttribute("notchq", DEFAULT_NOTCH_Q);
+            node->ref_mode = subNode->getIntAttribute("refmode", DEFAULT_REF_MODE);
+            node->ref_channel = subNode->getIntAttribute("refchannel", 1);
+            node->ref_groups = subNode->getStringAttribute("refgroups", "");
+            node->trigger_channel = subNode->getIntAttribute("triggerchannel", DEFAULT_TRIGGER_CHANNEL);
+
+            node->aux_streams = subNode->getStringAttribute("auxstreams", "");
+            if (node->aux_streams.isNotEmpty())
+            {
+                node->openAuxStreams();
+            }
+            channelCountInput->setText(String(node->num_channels), dontSendNotification);
+            sampleRateInput->setText(String((int) node->sample_rate), dontSendNotification);
+            CoreServices::updateSignalChain(this);
+            node->socket_address = subNode->getStringAttribute("socketaddress", "");
+            node->shm_name = subNode->getStringAttribute("shmname", "");
+            if ((node->replay_file.isNotEmpty() || node->socket_address.isNotEmpty() || node->shm_name.isNotEmpty())
+                && node->openBackend())
+            {
+                channelCountInput->setText(String(node->num_channels), dontSendNotification);
+                sampleRateInput->setText(String((int) node->sample_rate), dontSendNotification);
+                CoreServices::updateSignalChain(this);
+            }
+            updateInletFootprint();
+
         }
     }
 }
 
+void LSLinletEditor::updateInletFootprint()
+{
+    double footprint = node->getInletFootprint();
+    if (footprint > 0)
+    {
+        inletBufferLabel->setText("BUF " + String(footprint / 1e6, 1) + " MB / " + String(node->getInletBuflen()) + " s", dontSendNotification);
+    }
+    else
+    {
+        inletBufferLabel->setText("", dontSendNotification);
+    }
+}
+
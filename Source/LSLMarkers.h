@@ -0,0 +1,166 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Marker ingest
+
+
+Markers are pulled once per data chunk, as many as are waiting, with one chunked pull
+(lsl_pull_chunk_buf, the call behind pull_chunk_multiplexed for strings) instead of one
+pull_sample per marker. They land in an arena of strings that is reused from pull to pull,
+each reserved to MARKER_TEXT_BYTES, so pulling markers up to that length does not allocate on
+our side. Handing text markers on to the plugin as strings still does, for markers longer than
+the standard library's short string buffer (about 15 characters).
+Only the first channel of a multichannel marker stream is kept.
+
+Marker streams in an integer format (cf_int32, as most stimulus software sends them, or cf_int16
+or cf_int8) skip strings altogether: they are pulled with lsl_pull_chunk_i straight into an
+int32 buffer, the call behind pull_chunk_multiplexed(int32_t*, double*, ...), and stay numbers
+until they become TTL words, without any allocation.
+*/
+
+#ifndef OEP_LSL_MARKERS_H_INCLUDED
+#define OEP_LSL_MARKERS_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace LSLinletNode
+{
+	const int MARKER_CHUNK = 64;
+	const int MARKER_TEXT_BYTES = 64;
+
+	class MarkerArena
+	{
+	public:
+		MarkerArena() : numChans(1), numeric(false), count(0), received(0), ingestTicks(0), statStart(0) {
+			configure(lsl::stream_info());
+		}
+
+		/*
+		* @param info the marker stream
+		*/
+		void configure(const lsl::stream_info& info) {
+			const int format = info.channel_format();
+			numeric = format == lsl::cf_int32 || format == lsl::cf_int16 || format == lsl::cf_int8;
+			numChans = jmax(1, info.channel_count());
+			raw.assign(numeric ? 0 : MARKER_CHUNK * numChans, nullptr);
+			lengths.assign(numeric ? 0 : MARKER_CHUNK * numChans, 0);
+			codes.assign(numeric ? MARKER_CHUNK * numChans : 0, 0);
+			ts.assign(MARKER_CHUNK, 0.0);
+			texts.resize(numeric ? 0 : MARKER_CHUNK);
+			for (int k = 0; k < (int)texts.size(); k++) {
+				texts[k].reserve(MARKER_TEXT_BYTES);
+			}
+			count = 0;
+		}
+
+		bool isNumeric() const {
+			return numeric;
+		}
+
+		/*
+		* Take up to MARKER_CHUNK waiting markers without blocking
+		* @return markers pulled; MARKER_CHUNK means more may be waiting
+		*/
+		int pull(lsl::stream_inlet& in) {
+			int32_t ec = 0;
+			if (numeric) {
+				unsigned long n = lsl_pull_chunk_i(in.handle().get(), codes.data(), ts.data(),
+					(unsigned long)codes.size(), (unsigned long)ts.size(), 0.0, &ec);
+				count = ec == 0 ? int(n / numChans) : 0;
+				return count;
+			}
+			unsigned long n = lsl_pull_chunk_buf(in.handle().get(), raw.data(), lengths.data(), ts.data(),
+				(unsigned long)raw.size(), (unsigned long)ts.size(), 0.0, &ec);
+			count = ec == 0 ? int(n / numChans) : 0;
+			for (unsigned long k = 0; k < n; k++) {
+				if (k % numChans == 0 && ec == 0) {
+					texts[k / numChans].assign(raw[k], lengths[k]);
+				}
+				lsl_destroy_string(raw[k]);
+			}
+			return count;
+		}
+
+		int size() const {
+			return count;
+		}
+
+		const std::string& text(int k) const {
+			return texts[k];
+		}
+
+		int32_t code(int k) const {
+			return codes[k * numChans];
+		}
+
+		double timestamp(int k) const {
+			return ts[k];
+		}
+
+		/*
+		* Count n markers that took ticks to pull and queue
+		*/
+		void addIngest(int n, int64 ticks) {
+			received += n;
+			ingestTicks += ticks;
+		}
+
+		/*
+		* Markers per second and the cost of each since the last call. Runs on the message
+		* thread while the acquisition thread counts.
+		*/
+		void printStats() {
+			double now = Time::getMillisecondCounterHiRes() / 1000.0;
+			const int64 n = received.exchange(0);
+			const int64 ticks = ingestTicks.exchange(0);
+			if (n > 0 && statStart > 0) {
+				std::cout << "LSL markers (" << (numeric ? "int32" : "string") << "): " << n << ", "
+					<< n / (now - statStart) << " per s, "
+					<< Time::highResolutionTicksToSeconds(ticks) * 1e6 / n << " us per marker" << std::endl;
+			}
+			statStart = now;
+		}
+
+	private:
+		int numChans;
+		bool numeric;
+		int count;
+		std::atomic<int64> received;
+		std::atomic<int64> ingestTicks;
+		double statStart;
+		std::vector<char*> raw;
+		std::vector<uint32_t> lengths;
+		std::vector<int32_t> codes;
+		std::vector<double> ts;
+		std::vector<std::string> texts;
+
+		JUCE_LEAK_DETECTOR(MarkerArena);
+	};
+}
+
+#endif // OEP_LSL_MARKERS_H_INCLUDED
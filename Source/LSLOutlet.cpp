@@ -0,0 +1,164 @@
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "LSLOutlet.h"
+#include "LSLOutletEditor.h"
+
+using namespace LSLOutletNode;
+
+LSLOutlet::LSLOutlet() : GenericProcessor("LSL Outlet"),
+    stream_name("OpenEphys"),
+    stream_type("EEG"),
+    channel_list("1-8"),
+    chunk_size(DEFAULT_OUTLET_CHUNK),
+    chunkSamps(0)
+{
+    setProcessorType(PROCESSOR_TYPE_SINK);
+}
+
+LSLOutlet::~LSLOutlet()
+{
+}
+
+AudioProcessorEditor* LSLOutlet::createEditor()
+{
+    editor = new LSLOutletEditor(this, this);
+    return editor;
+}
+
+void LSLOutlet::parseChannelList()
+{
+    channels.clear();
+
+    StringArray tokens = StringArray::fromTokens(channel_list, ",", "");
+    for (int t = 0; t < tokens.size(); t++)
+    {
+        String token = tokens[t].trim();
+        if (token.isEmpty())
+            continue;
+
+        int first = token.upToFirstOccurrenceOf("-", false, false).getIntValue();
+        int last = token.indexOfChar('-') >= 0 ? token.fromFirstOccurrenceOf("-", false, false).getIntValue() : first;
+
+        for (int ch = first; ch <= last; ch++)
+        {
+            if (ch >= 1 && ch <= getTotalDataChannels())
+                channels.addIfNotAlreadyThere(ch - 1);
+        }
+    }
+}
+
+void LSLOutlet::updateSettings()
+{
+    parseChannelList();
+}
+
+bool LSLOutlet::enable()
+{
+    parseChannelList();
+
+    if (channels.size() == 0)
+    {
+        std::cout << "LSL outlet: no channels selected" << std::endl;
+        return false;
+    }
+
+    // One outlet has one rate and one block length, so all channels must share a subprocessor
+    const DataChannel* first = getDataChannel(channels[0]);
+    for (int i = 1; i < channels.size(); i++)
+    {
+        const DataChannel* chan = getDataChannel(channels[i]);
+        if (chan->getSourceNodeID() != first->getSourceNodeID() || chan->getSubProcessorIdx() != first->getSubProcessorIdx())
+        {
+            std::cout << "LSL outlet: channels " << channels[0] + 1 << " and " << channels[i] + 1
+                << " come from different subprocessors, send them through separate outlets" << std::endl;
+            return false;
+        }
+    }
+
+    float fs = first->getSampleRate();
+
+    lsl::stream_info info(stream_name.toStdString(), stream_type.toStdString(),
+        channels.size(), fs, lsl::cf_float32, "openephys-" + String(getNodeId()).toStdString());
+
+    lsl::xml_element chns = info.desc().append_child("channels");
+    for (int i = 0; i < channels.size(); i++)
+    {
+        lsl::xml_element ch = chns.append_child("channel");
+        ch.append_child_value("label", getDataChannel(channels[i])->getName().toStdString());
+        ch.append_child_value("unit", "microvolts");
+    }
+
+    outlet = new lsl::stream_outlet(info, chunk_size);
+
+    // Everything the audio thread touches is allocated here
+    chunkbuf.malloc(chunk_size * channels.size());
+    chunkSamps = 0;
+
+    statBlocks = 0;
+    statValues = 0;
+    statTicks = 0;
+
+    return true;
+}
+
+bool LSLOutlet::disable()
+{
+    if (outlet != nullptr && chunkSamps > 0)
+    {
+        outlet->push_chunk_multiplexed(chunkbuf.getData(), chunkSamps * channels.size());
+    }
+
+    if (statBlocks > 0)
+    {
+        std::cout << "LSL outlet blocks: " << statBlocks
+            << ", values per block: " << double(statValues) / statBlocks
+            << ", mean push time: " << Time::highResolutionTicksToSeconds(statTicks) * 1e6 / statBlocks << " us/block" << std::endl;
+    }
+
+    outlet = nullptr;
+    chunkSamps = 0;
+
+    return true;
+}
+
+void LSLOutlet::process(AudioSampleBuffer& buffer)
+{
+    if (outlet == nullptr)
+        return;
+
+    int64 start = Time::getHighResolutionTicks();
+
+    const int nChans = channels.size();
+    const int nSamps = getNumSamples(channels[0]);
+
+    int i = 0;
+    while (i < nSamps)
+    {
+        // Interleave directly from the processing buffer into the pending chunk
+        int n = jmin(nSamps - i, chunk_size - chunkSamps);
+
+        for (int c = 0; c < nChans; c++)
+        {
+            const float* src = buffer.getReadPointer(channels[c], i);
+            float* dest = chunkbuf.getData() + chunkSamps * nChans + c;
+
+            for (int k = 0; k < n; k++)
+                dest[k * nChans] = src[k];
+        }
+
+        chunkSamps += n;
+        i += n;
+
+        if (chunkSamps == chunk_size)
+        {
+            outlet->push_chunk_multiplexed(chunkbuf.getData(), chunk_size * nChans);
+            chunkSamps = 0;
+        }
+    }
+
+    statTicks += Time::getHighResolutionTicks() - start;
+    statValues += nSamps * nChans;
+    statBlocks++;
+}
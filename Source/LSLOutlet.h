@@ -0,0 +1,55 @@
+#ifndef __LSLOUTLETH__
+#define __LSLOUTLETH__
+
+#include <ProcessorHeaders.h>
+#include <lsl_cpp.h>
+
+const int DEFAULT_OUTLET_CHUNK = 32;
+
+namespace LSLOutletNode
+{
+    /*
+    Sink that republishes selected continuous channels as an LSL stream.
+    Samples are interleaved straight from the processing buffer into a preallocated
+    chunk, which is handed to push_chunk_multiplexed once chunk_size samples are pending.
+    */
+    class LSLOutlet : public GenericProcessor
+    {
+
+    public:
+        LSLOutlet();
+        ~LSLOutlet();
+
+        AudioProcessorEditor* createEditor() override;
+
+        void process(AudioSampleBuffer& buffer) override;
+        void updateSettings() override;
+        bool enable() override;
+        bool disable() override;
+
+        // User defined
+        String stream_name;
+        String stream_type;
+        String channel_list;
+        int chunk_size;
+
+    private:
+        // Turns "1-4,7" into zero based channel indices, skipping anything out of range
+        void parseChannelList();
+
+        Array<int> channels;
+
+        ScopedPointer<lsl::stream_outlet> outlet;
+
+        HeapBlock<float> chunkbuf;
+        int chunkSamps;
+
+        // Push path cost, printed when acquisition stops
+        int64 statBlocks;
+        int64 statValues;
+        int64 statTicks;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LSLOutlet);
+    };
+}
+#endif
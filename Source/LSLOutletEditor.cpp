@@ -0,0 +1,131 @@
+#include "LSLOutletEditor.h"
+#include "LSLOutlet.h"
+
+#include <string>
+#include <iostream>
+
+using namespace LSLOutletNode;
+
+LSLOutletEditor::LSLOutletEditor(GenericProcessor* parentNode, LSLOutlet* outlet) : GenericEditor(parentNode, false)
+{
+    node = outlet;
+
+    desiredWidth = 180;
+
+    // Stream name
+    nameLabel = new Label("NAME", "NAME");
+    nameLabel->setFont(Font("Small Text", 10, Font::plain));
+    nameLabel->setBounds(5, 30, 65, 8);
+    nameLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(nameLabel);
+
+    nameInput = new Label("Name", node->stream_name);
+    nameInput->setFont(Font("Small Text", 10, Font::plain));
+    nameInput->setBounds(10, 42, 160, 15);
+    nameInput->setEditable(true);
+    nameInput->setColour(Label::backgroundColourId, Colours::lightgrey);
+    nameInput->addListener(this);
+    addAndMakeVisible(nameInput);
+
+    // Channels
+    channelsLabel = new Label("CHANNELS", "CHANNELS");
+    channelsLabel->setFont(Font("Small Text", 10, Font::plain));
+    channelsLabel->setBounds(5, 65, 85, 8);
+    channelsLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(channelsLabel);
+
+    channelsInput = new Label("Channels", node->channel_list);
+    channelsInput->setFont(Font("Small Text", 10, Font::plain));
+    channelsInput->setBounds(10, 77, 90, 15);
+    channelsInput->setEditable(true);
+    channelsInput->setColour(Label::backgroundColourId, Colours::lightgrey);
+    channelsInput->addListener(this);
+    addAndMakeVisible(channelsInput);
+
+    // Chunk size
+    chunkLabel = new Label("CHUNK", "CHUNK");
+    chunkLabel->setFont(Font("Small Text", 10, Font::plain));
+    chunkLabel->setBounds(105, 65, 65, 8);
+    chunkLabel->setColour(Label::textColourId, Colours::darkgrey);
+    addAndMakeVisible(chunkLabel);
+
+    chunkInput = new Label("Chunk", String(node->chunk_size));
+    chunkInput->setFont(Font("Small Text", 10, Font::plain));
+    chunkInput->setBounds(110, 77, 60, 15);
+    chunkInput->setEditable(true);
+    chunkInput->setColour(Label::backgroundColourId, Colours::lightgrey);
+    chunkInput->addListener(this);
+    addAndMakeVisible(chunkInput);
+}
+
+void LSLOutletEditor::labelTextChanged(Label* label)
+{
+    if (label == nameInput)
+    {
+        if (nameInput->getText().isNotEmpty())
+        {
+            node->stream_name = nameInput->getText();
+        }
+        else {
+            nameInput->setText(node->stream_name, dontSendNotification);
+        }
+    }
+    else if (label == channelsInput)
+    {
+        node->channel_list = channelsInput->getText();
+        CoreServices::updateSignalChain(this);
+    }
+    else if (label == chunkInput)
+    {
+        int chunkSize = chunkInput->getText().getIntValue();
+
+        if (chunkSize > 0 && chunkSize < 100000)
+        {
+            node->chunk_size = chunkSize;
+        }
+        else {
+            chunkInput->setText(String(node->chunk_size), dontSendNotification);
+        }
+    }
+}
+
+void LSLOutletEditor::startAcquisition()
+{
+    nameInput->setEnabled(false);
+    channelsInput->setEnabled(false);
+    chunkInput->setEnabled(false);
+}
+
+void LSLOutletEditor::stopAcquisition()
+{
+    nameInput->setEnabled(true);
+    channelsInput->setEnabled(true);
+    chunkInput->setEnabled(true);
+}
+
+void LSLOutletEditor::saveCustomParameters(XmlElement* xmlNode)
+{
+    XmlElement* parameters = xmlNode->createNewChildElement("PARAMETERS");
+
+    parameters->setAttribute("name", nameInput->getText());
+    parameters->setAttribute("channels", channelsInput->getText());
+    parameters->setAttribute("chunk", chunkInput->getText());
+}
+
+void LSLOutletEditor::loadCustomParameters(XmlElement* xmlNode)
+{
+    forEachXmlChildElement(*xmlNode, subNode)
+    {
+        if (subNode->hasTagName("PARAMETERS"))
+        {
+            node->stream_name = subNode->getStringAttribute("name", node->stream_name);
+            nameInput->setText(node->stream_name, dontSendNotification);
+
+            node->channel_list = subNode->getStringAttribute("channels", node->channel_list);
+            channelsInput->setText(node->channel_list, dontSendNotification);
+
+            node->chunk_size = subNode->getIntAttribute("chunk", DEFAULT_OUTLET_CHUNK);
+            chunkInput->setText(String(node->chunk_size), dontSendNotification);
+        }
+    }
+}
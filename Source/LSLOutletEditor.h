@@ -0,0 +1,57 @@
+#ifndef __LSLOUTLETEDITORH__
+#define __LSLOUTLETEDITORH__
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <EditorHeaders.h>
+
+namespace LSLOutletNode
+{
+    class LSLOutlet;
+
+    class LSLOutletEditor : public GenericEditor, public Label::Listener
+    {
+
+    public:
+
+        LSLOutletEditor(GenericProcessor* parentNode, LSLOutlet *node);
+
+        /** Called by processor graph in beginning of the acqusition, disables editor completly. */
+        void startAcquisition();
+
+        /** Called by processor graph at the end of the acqusition, reenables editor completly. */
+        void stopAcquisition();
+
+        /** Called when configuration is saved. Adds editors config to xml. */
+        void saveCustomParameters(XmlElement* xml) override;
+
+        /** Called when configuration is loaded. Reads editors config from xml. */
+        void loadCustomParameters(XmlElement* xml) override;
+
+        /** Called when label is changed */
+        void labelTextChanged(Label* label);
+
+    private:
+
+        // Stream name
+        ScopedPointer<Label> nameLabel;
+        ScopedPointer<Label> nameInput;
+
+        // Channels to publish
+        ScopedPointer<Label> channelsLabel;
+        ScopedPointer<Label> channelsInput;
+
+        // Samples per pushed chunk
+        ScopedPointer<Label> chunkLabel;
+        ScopedPointer<Label> chunkInput;
+
+        // Parent node
+        LSLOutlet* node;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LSLOutletEditor);
+    };
+}
+
+#endif
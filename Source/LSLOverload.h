@@ -0,0 +1,283 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Overload policy
+
+
+When acquisition falls behind the outlet, the inlet's backlog (samples_available()) grows
+until max_buflen is reached and liblsl starts discarding the oldest samples on its own. An
+overload policy degrades in a controlled way instead, once the backlog passes a threshold:
+	OVERLOAD_DROP       the backlog is discarded down to one pull, back to real time at once
+	OVERLOAD_DECIMATE   each sample handed out averages several received ones until the
+	                    backlog is down to half the threshold
+	OVERLOAD_BLOCK      acquisition waits for room in the source buffer rather than overflowing
+	                    it, so nothing is lost until the inlet's own buffer is full. Below the
+	                    threshold the source buffer overflows as it would without a policy.
+Every overload is logged with the LSL timestamps (as sent, before clock mapping) of the first
+and last sample it affected, so it can be matched against an XDF recording; with a log file
+each is also written there as a CSV line. The acquisition thread only queues the overload in a
+fixed ring; the line is written by whichever thread calls writeLog(), the message thread here.
+Its after_stream_sample column counts samples as the stream handed them on, before the
+plugin's own decimation.
+*/
+
+#ifndef OEP_LSL_OVERLOAD_H_INCLUDED
+#define OEP_LSL_OVERLOAD_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <atomic>
+#include "LogRing.h"
+
+namespace LSLinletNode
+{
+	enum OverloadPolicy
+	{
+		OVERLOAD_NONE = 0,
+		OVERLOAD_DROP = 1,
+		OVERLOAD_DECIMATE = 2,
+		OVERLOAD_BLOCK = 3
+	};
+
+	const int DEFAULT_OVERLOAD_POLICY = OVERLOAD_NONE;
+	const float DEFAULT_OVERLOAD_MS = 500.0f;
+	const int OVERLOAD_DECIMATION = 4;
+	const int OVERLOAD_LOG_SLOTS = 64;
+
+	/*
+	Decides when the backlog is an overload and keeps the record of what was done about it
+	*/
+	class OverloadGuard
+	{
+	public:
+		OverloadGuard() : ring(nullptr), policy(OVERLOAD_NONE), threshold(0), active(false), position(0),
+			events(0), dropped(0), decimated(0), delayed(0), maxBacklog(0), firstTs(0), lastTs(0), affected(0),
+			head(0), tail(0), unlogged(0) {}
+
+		/*
+		* @param policyIn one of OverloadPolicy
+		* @param thresholdSamples backlog that starts an overload, 0 for off
+		* @param logFile CSV file overloads are appended to, or File() for none
+		* @param ringIn where overloads are logged from the acquisition thread
+		*/
+		void configure(int policyIn, int64 thresholdSamples, const File& logFile, LogRing* ringIn) {
+			writeLog();
+			ring = ringIn;
+			policy = policyIn;
+			threshold = thresholdSamples;
+			log = nullptr;
+			if (logFile.getFullPathName().isNotEmpty() && policy != OVERLOAD_NONE) {
+				// Appends to an existing log
+				log = new FileOutputStream(logFile);
+				if (!log->openedOk()) {
+					std::cout << "Could not open overload log " << logFile.getFullPathName() << std::endl;
+					log = nullptr;
+				}
+				else if (log->getPosition() == 0) {
+					log->writeText("policy,first_ts,last_ts,samples,after_stream_sample\n", false, false, nullptr);
+				}
+			}
+			reset();
+		}
+
+		void reset() {
+			active = false;
+			position = 0;
+		}
+
+		bool enabled() const {
+			return policy != OVERLOAD_NONE && threshold > 0;
+		}
+
+		int getPolicy() const {
+			return policy;
+		}
+
+		/*
+		* Look at the backlog before a pull
+		* @return true while an overload is being handled
+		*/
+		bool check(int64 backlog) {
+			maxBacklog = jmax(maxBacklog, backlog);
+			if (!active && backlog > threshold) {
+				active = true;
+				events++;
+				affected = 0;
+			}
+			else if (active && policy != OVERLOAD_DROP && backlog <= threshold / 2) {
+				finish();
+			}
+			return active;
+		}
+
+		/*
+		* n received samples, stamped first to last, were dropped, merged or pulled late
+		*/
+		void affect(double first, double last, int n) {
+			if (affected == 0) {
+				firstTs = first;
+			}
+			lastTs = last;
+			affected += n;
+			if (policy == OVERLOAD_DROP) {
+				dropped += n;
+			}
+			else if (policy == OVERLOAD_DECIMATE) {
+				decimated += n;
+			}
+			else {
+				delayed += n;
+			}
+		}
+
+		/*
+		* The overload is over; log what it affected
+		*/
+		void finish() {
+			if (!active) {
+				return;
+			}
+			active = false;
+			static const char* names[] = { "none", "drop", "decimate", "block" };
+			if (affected == 0) {
+				return;
+			}
+			if (ring != nullptr) {
+				ring->post("LSL overload (%s): %lld samples, LSL timestamps %.6f to %.6f, after sample %lld",
+					names[policy], (long long)affected, firstTs, lastTs, (long long)position);
+			}
+			if (log != nullptr) {
+				const uint32 h = head.load(std::memory_order_relaxed);
+				if (h - tail.load(std::memory_order_acquire) < (uint32)OVERLOAD_LOG_SLOTS) {
+					Record& r = records[h % OVERLOAD_LOG_SLOTS];
+					r.firstTs = firstTs;
+					r.lastTs = lastTs;
+					r.samples = affected;
+					r.position = position;
+					head.store(h + 1, std::memory_order_release);
+				}
+				else {
+					unlogged.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			affected = 0;
+		}
+
+		/*
+		* Append the overloads finish() queued to the log file. Not called from the acquisition thread.
+		*/
+		void writeLog() {
+			if (log == nullptr) {
+				return;
+			}
+			static const char* names[] = { "none", "drop", "decimate", "block" };
+			uint32 t = tail.load(std::memory_order_relaxed);
+			const uint32 h = head.load(std::memory_order_acquire);
+			if (t == h) {
+				return;
+			}
+			for (; t != h; t++) {
+				const Record& r = records[t % OVERLOAD_LOG_SLOTS];
+				log->writeText(String(names[policy]) + "," + String(r.firstTs, 6) + "," + String(r.lastTs, 6) + ","
+					+ String(r.samples) + "," + String(r.position) + "\n", false, false, nullptr);
+				tail.store(t + 1, std::memory_order_release);
+			}
+			log->flush();
+			const int64 lost = unlogged.exchange(0, std::memory_order_relaxed);
+			if (lost > 0) {
+				std::cout << "LSL overload log: " << lost << " overloads not written, the queue was full" << std::endl;
+			}
+		}
+
+		/*
+		* Count samples handed out, which is where a logged gap sits
+		*/
+		void advance(int n) {
+			position += n;
+		}
+
+		/*
+		* Average groups of factor samples, the last group possibly shorter. Works in place.
+		* @return samples left
+		*/
+		static int decimate(float* data, double* ts, int n, int numChans, int factor) {
+			int out = 0;
+			for (int start = 0; start < n; start += factor, out++) {
+				const int len = jmin(factor, n - start);
+				float* dst = data + out * numChans;
+				const float* src = data + start * numChans;
+				for (int ch = 0; ch < numChans; ch++) {
+					float sum = 0;
+					for (int i = 0; i < len; i++) {
+						sum += src[i * numChans + ch];
+					}
+					dst[ch] = sum / len;
+				}
+				ts[out] = ts[start];
+			}
+			return out;
+		}
+
+		void printStats() {
+			if (events > 0) {
+				std::cout << "LSL overloads: " << events << ", samples dropped: " << dropped
+					<< ", decimated: " << decimated << ", delayed: " << delayed << ", largest backlog: " << maxBacklog
+					<< " samples" << (active ? ", overloaded now" : "") << std::endl;
+			}
+			maxBacklog = 0;
+		}
+
+	private:
+		struct Record
+		{
+			double firstTs;
+			double lastTs;
+			int64 samples;
+			int64 position;
+		};
+
+		LogRing* ring;
+		int policy;
+		int64 threshold;
+		bool active;
+		int64 position;
+		ScopedPointer<FileOutputStream> log;
+
+		int64 events;
+		int64 dropped;
+		int64 decimated;
+		int64 delayed;
+		int64 maxBacklog;
+
+		double firstTs;
+		double lastTs;
+		int64 affected;
+
+		Record records[OVERLOAD_LOG_SLOTS];
+		std::atomic<uint32> head;
+		std::atomic<uint32> tail;
+		std::atomic<int64> unlogged;
+	};
+}
+
+#endif // OEP_LSL_OVERLOAD_H_INCLUDED
@@ -0,0 +1,275 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Stream reconnection
+
+
+When the EEG outlet goes away (crash, restart of the acquisition software, cable pulled) the
+inlet keeps waiting on it. The acquisition thread notices that pulls have returned nothing for
+longer than the reconnect timeout and hands the stream's identity to StreamResolver, which
+resolves it again in the background, by source_id if the outlet set one and by name and type
+otherwise. Acquisition keeps running. The resolver also opens the inlet on the new outlet and
+connects it, so all the acquisition thread does once the stream is found is swap it in; the
+old inlet is released on the resolver's thread later.
+
+The samples the outage cost are put back by GapFiller, so sample numbers downstream stay on
+the timeline of the timestamps: the gap between the last sample before the outage and the
+first one after it is filled with zeros or the last sample, with evenly spaced timestamps.
+The gap is measured between the timestamps as sent, before clock mapping, when the outlet came
+back on the same host and so on the same clock; otherwise between the arrival times. Gaps
+longer than MAX_GAP_FILL_SECONDS are only filled that far, and logged with their full length.
+*/
+
+#ifndef OEP_LSL_RECONNECT_H_INCLUDED
+#define OEP_LSL_RECONNECT_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+namespace LSLinletNode
+{
+	const double DEFAULT_RECONNECT_TIMEOUT = 2.0;
+	const double MAX_GAP_FILL_SECONDS = 60.0;
+	const double RESOLVER_OPEN_TIMEOUT = 2.0;
+
+	enum GapFillMode
+	{
+		GAP_NONE = 0,
+		GAP_ZEROS = 1,
+		GAP_HOLD = 2
+	};
+
+	const int DEFAULT_GAP_FILL = GAP_ZEROS;
+
+	/*
+	Resolves a lost stream again on its own thread
+	*/
+	class StreamResolver : public Thread
+	{
+	public:
+		StreamResolver() : Thread("LSL Resolver"), maxBuflen(360), maxChunklen(0), found(false) {}
+
+		~StreamResolver() {
+			stopThread(3000);
+		}
+
+		/*
+		* Start looking for the stream lost is a description of
+		* @param buflen, chunklen how to open the inlet on the stream once it is found
+		*/
+		void search(const lsl::stream_info& lost, int32_t buflen, int32_t chunklen) {
+			stopThread(3000);
+			const std::string id = lost.source_id();
+			query = id.empty() ? "name='" + lost.name() + "' and type='" + lost.type() + "'"
+				: "source_id='" + id + "'";
+			maxBuflen = buflen;
+			maxChunklen = chunklen;
+			found = false;
+			startThread();
+		}
+
+		/*
+		* @return true once, with the stream that was found
+		*/
+		bool take(lsl::stream_info& info) {
+			const ScopedLock lock(resultLock);
+			if (!found) {
+				return false;
+			}
+			info = result;
+			found = false;
+			return true;
+		}
+
+		/*
+		* Trade in with the inlet opened on the stream take() returned. The inlet handed in is
+		* released by the next search, or when the resolver goes away.
+		*/
+		void swapInlet(lsl::stream_inlet& in) {
+			const ScopedLock lock(resultLock);
+			jassert(ready != nullptr);
+			std::swap(in, *ready);
+		}
+
+		void run() override {
+			{
+				// Whatever the last search left over, let go of it here
+				const ScopedLock lock(resultLock);
+				ready = nullptr;
+			}
+			while (!threadShouldExit()) {
+				std::vector<lsl::stream_info> streams = lsl::resolve_stream(query, 1, 1.0);
+				if (!streams.empty()) {
+					ScopedPointer<lsl::stream_inlet> in = new lsl::stream_inlet(streams[0], maxBuflen, maxChunklen);
+					try {
+						in->open_stream(RESOLVER_OPEN_TIMEOUT);
+					}
+					catch (std::exception&) {
+					}
+					const ScopedLock lock(resultLock);
+					result = streams[0];
+					ready = in.release();
+					found = true;
+					return;
+				}
+			}
+		}
+
+	private:
+		std::string query;
+		int32_t maxBuflen;
+		int32_t maxChunklen;
+		CriticalSection resultLock;
+		lsl::stream_info result;
+		ScopedPointer<lsl::stream_inlet> ready;
+		bool found;
+	};
+
+	/*
+	Puts the samples lost during an outage back
+	*/
+	class GapFiller
+	{
+	public:
+		GapFiller() : numChans(0), srate(0), mode(GAP_NONE), lastTs(0), lastSentTs(0), haveLast(false), remaining(0), nextTs(0), missing(0),
+			filled(0), gaps(0) {}
+
+		/*
+		* @param nChans channels per sample
+		* @param rate nominal sample rate
+		* @param modeIn one of GapFillMode
+		*/
+		void configure(int nChans, double rate, int modeIn) {
+			numChans = nChans;
+			srate = rate;
+			mode = modeIn;
+			last.assign(numChans, 0.0f);
+			reset();
+		}
+
+		void reset() {
+			haveLast = false;
+			remaining = 0;
+		}
+
+		/*
+		* Remember the newest of n samples just handed out
+		*/
+		void note(const float* data, const double* ts, int n) {
+			if (n > 0) {
+				memcpy(last.data(), data + (n - 1) * numChans, numChans * sizeof(float));
+				lastTs = ts[n - 1];
+				haveLast = true;
+			}
+		}
+
+		/*
+		* Remember the timestamp, as sent, of the newest sample pulled
+		*/
+		void noteSent(double ts) {
+			lastSentTs = ts;
+		}
+
+		double lastSent() const {
+			return lastSentTs;
+		}
+
+		/*
+		* Data resumed; work out how many samples are missing
+		* @param gapSeconds time between the last sample before the outage and the first one after it
+		* @return samples that will be filled
+		*/
+		int64 begin(double gapSeconds) {
+			remaining = 0;
+			missing = 0;
+			if (mode == GAP_NONE || !haveLast || srate <= 0) {
+				return 0;
+			}
+			missing = jmax((int64)0, (int64)std::floor(gapSeconds * srate + 0.5) - 1);
+			remaining = jmin((int64)(MAX_GAP_FILL_SECONDS * srate), missing);
+			nextTs = lastTs + 1.0 / srate;
+			if (remaining > 0) {
+				gaps++;
+			}
+			return remaining;
+		}
+
+		/*
+		* Write up to maxSamps fill samples
+		* @return samples written, 0 once the gap is closed
+		*/
+		int fill(float* data, double* ts, int maxSamps) {
+			int n = (int)jmin((int64)maxSamps, remaining);
+			for (int i = 0; i < n; i++) {
+				if (mode == GAP_HOLD) {
+					memcpy(data + i * numChans, last.data(), numChans * sizeof(float));
+				}
+				else {
+					memset(data + i * numChans, 0, numChans * sizeof(float));
+				}
+				ts[i] = nextTs + i / srate;
+			}
+			nextTs += n / srate;
+			remaining -= n;
+			filled += n;
+			return n;
+		}
+
+		/*
+		* Samples the last gap was missing, including those beyond MAX_GAP_FILL_SECONDS
+		*/
+		int64 missingCount() const {
+			return missing;
+		}
+
+		int64 filledCount() const {
+			return filled.load();
+		}
+
+		int64 gapCount() const {
+			return gaps.load();
+		}
+
+	private:
+		int numChans;
+		double srate;
+		int mode;
+		std::vector<float> last;
+		double lastTs;
+		double lastSentTs;
+		bool haveLast;
+		int64 remaining;
+		double nextTs;
+		int64 missing;
+
+		// Counted on the acquisition thread, read from the message thread
+		std::atomic<int64> filled;
+		std::atomic<int64> gaps;
+	};
+}
+
+#endif // OEP_LSL_RECONNECT_H_INCLUDED
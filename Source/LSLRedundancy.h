@@ -0,0 +1,190 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Hot standby
+
+
+With two identical outlets (primary and backup acquisition PCs) both inlets are read all the
+time. The backup's samples, with timestamps mapped onto the local clock, wait in a
+StandbyBuffer. Whatever has been handed out downstream is trimmed from it by timestamp, so at
+any moment it holds exactly the samples the primary has not delivered yet. If the primary
+is quiet for longer than the failover delay, the buffer is played out instead, and when the
+primary comes back its samples at or before the last one handed out are dropped as
+duplicates. If the primary lost samples while it was quiet, its first samples back wait in a
+second buffer until the standby has played out everything older than them. Either way there
+is neither a gap nor a repeat, to within the clock sync error.
+
+Deduplication is by timestamp with a tolerance of half a sample, so both streams need clock
+synchronization (or a shared clock) and the same rate.
+
+Unless a failover delay is set, it is FAILOVER_CHUNKS times the primary's chunk interval: at
+first the longer of the pull and the transmission chunk length, then the measured time between
+its chunks, so a primary that merely sends large chunks is not taken for a quiet one.
+*/
+
+#ifndef OEP_LSL_REDUNDANCY_H_INCLUDED
+#define OEP_LSL_REDUNDANCY_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <atomic>
+#include <vector>
+
+namespace LSLinletNode
+{
+	const float DEFAULT_FAILOVER_MS = 0.0f;
+	const double FAILOVER_CHUNKS = 3.0;
+	const double STANDBY_SECONDS = 2.0;
+
+	enum BlockSource
+	{
+		SOURCE_PRIMARY = 0,
+		SOURCE_BACKUP = 1
+	};
+
+	/*
+	Backup samples not yet covered by what was handed out downstream
+	*/
+	class StandbyBuffer
+	{
+	public:
+		StandbyBuffer() : numChans(0), capacity(0), count(0), dropped(0) {}
+
+		void configure(int nChans, int capacityIn) {
+			numChans = nChans;
+			capacity = capacityIn;
+			data.assign(capacity * numChans, 0.0f);
+			ts.assign(capacity, 0.0);
+			count = 0;
+		}
+
+		void clear() {
+			count = 0;
+		}
+
+		/*
+		* Make room for at least n more samples, dropping the oldest if the primary has been
+		* covering for a long time and nothing trimmed them
+		*/
+		void reserve(int n) {
+			if (capacity - count < n) {
+				int drop = jmin(count, n - (capacity - count));
+				dropped += drop;
+				discardFirst(drop);
+			}
+		}
+
+		float* tailData() {
+			return data.data() + count * numChans;
+		}
+
+		double* tailTs() {
+			return ts.data() + count;
+		}
+
+		int space() const {
+			return capacity - count;
+		}
+
+		void added(int n) {
+			count += n;
+		}
+
+		/*
+		* Forget samples stamped at or before t
+		*/
+		void trimThrough(double t) {
+			int n = 0;
+			while (n < count && ts[n] <= t) {
+				n++;
+			}
+			discardFirst(n);
+		}
+
+		/*
+		* Append n samples at the end
+		*/
+		void append(const float* src, const double* srcTs, int n) {
+			reserve(n);
+			n = jmin(n, capacity - count);
+			memcpy(tailData(), src, n * numChans * sizeof(float));
+			memcpy(tailTs(), srcTs, n * sizeof(double));
+			count += n;
+		}
+
+		double frontTs() const {
+			return ts[0];
+		}
+
+		/*
+		* Move up to maxSamps of the oldest samples stamped before t out
+		*/
+		int takeBefore(float* out, double* outTs, int maxSamps, double t) {
+			int n = 0;
+			while (n < count && n < maxSamps && ts[n] < t) {
+				n++;
+			}
+			return take(out, outTs, n);
+		}
+
+		/*
+		* Move up to maxSamps of the oldest samples out
+		*/
+		int take(float* out, double* outTs, int maxSamps) {
+			int n = jmin(maxSamps, count);
+			memcpy(out, data.data(), n * numChans * sizeof(float));
+			memcpy(outTs, ts.data(), n * sizeof(double));
+			count -= n;
+			memmove(data.data(), data.data() + n * numChans, count * numChans * sizeof(float));
+			memmove(ts.data(), ts.data() + n, count * sizeof(double));
+			return n;
+		}
+
+		int size() const {
+			return count;
+		}
+
+		int64 droppedCount() const {
+			return dropped.load();
+		}
+
+	private:
+		void discardFirst(int n) {
+			if (n <= 0) {
+				return;
+			}
+			count -= n;
+			memmove(data.data(), data.data() + n * numChans, count * numChans * sizeof(float));
+			memmove(ts.data(), ts.data() + n, count * sizeof(double));
+		}
+
+		int numChans;
+		int capacity;
+		int count;
+		std::vector<float> data;
+		std::vector<double> ts;
+		std::atomic<int64> dropped;
+	};
+}
+
+#endif // OEP_LSL_REDUNDANCY_H_INCLUDED
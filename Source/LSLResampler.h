@@ -0,0 +1,246 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Multichannel resampler
+
+
+Rates whose ratio reduces to L/M with small L and M (100 -> 500 Hz is 5/1, 2000 -> 500 Hz
+is 1/4, 500 -> 2000 Hz is 4/1) use a polyphase FIR: a windowed-sinc lowpass designed at L times
+the input rate, split into L phases, of which each output sample needs exactly one. When
+downsampling by M, each phase has RESAMPLER_TAPS x ceil(M/L) taps so the stopband still rejects
+what would alias below the new Nyquist frequency. Any other
+ratio uses the same kind of filter bank with RESAMPLER_PHASES phases, picking the phase nearest
+to each output sample's fractional position.
+
+Data is multiplexed (sample major), so the inner loop of every tap runs over contiguous
+channels with no dependencies between iterations, which the compiler vectorizes.
+*/
+
+#ifndef OEP_LSL_RESAMPLER_H_INCLUDED
+#define OEP_LSL_RESAMPLER_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <cmath>
+
+namespace LSLinletNode
+{
+	const int RESAMPLER_TAPS = 16;          // taps per phase per unit of the downsampling ratio
+	const int RESAMPLER_MAX_RATIO = 64;     // largest L or M handled as a rational ratio
+	const int RESAMPLER_PHASES = 256;       // phases of the fractional filter bank
+
+	class Resampler
+	{
+	public:
+		Resampler() : numChans(0), inRate(0), outRate(0), phases(1), step(1), taps(RESAMPLER_TAPS), rational(true) {}
+
+		/*
+		* @return false if the rates are not usable
+		*/
+		bool configure(int nChans, double inRateIn, double outRateIn) {
+			numChans = nChans;
+			inRate = inRateIn;
+			outRate = outRateIn;
+			if (inRate <= 0 || outRate <= 0 || numChans <= 0) {
+				return false;
+			}
+
+			// Rational if both rates are (close to) whole numbers with a small reduced ratio
+			int64 a = (int64)std::llround(outRate);
+			int64 b = (int64)std::llround(inRate);
+			rational = std::abs(a - outRate) < 1e-6 && std::abs(b - inRate) < 1e-6;
+			if (rational) {
+				int64 g = gcd(a, b);
+				a /= g;
+				b /= g;
+				rational = a <= RESAMPLER_MAX_RATIO && b <= RESAMPLER_MAX_RATIO;
+			}
+
+			if (rational) {
+				phases = (int)a;
+				step = (int)b;
+			}
+			else {
+				phases = RESAMPLER_PHASES;
+				fracStep = inRate / outRate;
+			}
+
+			// Downsampling by M needs a filter M times as long for the same stopband, as in the decimator
+			taps = RESAMPLER_TAPS * jmax(1, (int)std::ceil(inRate / outRate - 1e-9));
+			design();
+
+			history.assign((taps - 1) * numChans, 0.0f);
+			reset();
+			return true;
+		}
+
+		void reset() {
+			std::fill(history.begin(), history.end(), 0.0f);
+			phaseAcc = 0;
+			fracPos = 0;
+		}
+
+		/*
+		* Filter delay, in input samples
+		*/
+		double delay() const {
+			return (phases * taps - 1) / (2.0 * phases);
+		}
+
+		bool isRational() const {
+			return rational;
+		}
+
+		/*
+		* Most output samples produced from nIn input samples
+		*/
+		int maxOutput(int nIn) const {
+			return int(std::ceil(nIn * outRate / inRate)) + 2;
+		}
+
+		/*
+		* Resample a chunk
+		* @param in multiplexed input, nIn x numChans
+		* @param out multiplexed output with room for maxOutput(nIn) samples
+		* @return number of output samples written
+		*/
+		int process(const float* in, int nIn, float* out) {
+			// work = history followed by this chunk, so taps can reach back across chunks
+			const int hist = taps - 1;
+			work.resize((hist + nIn) * numChans);
+			std::copy(history.begin(), history.end(), work.begin());
+			std::copy(in, in + nIn * numChans, work.begin() + hist * numChans);
+
+			int nOut = 0;
+			if (rational) {
+				// Output position in the upsampled domain is phaseAcc; its input sample is phaseAcc / L
+				while (phaseAcc < (int64)nIn * phases) {
+					int i = int(phaseAcc / phases);
+					int phase = int(phaseAcc % phases);
+					convolve(&work[(i + hist) * numChans], &bank[phase * taps], out + nOut * numChans);
+					nOut++;
+					phaseAcc += step;
+				}
+				phaseAcc -= (int64)nIn * phases;
+			}
+			else {
+				while (fracPos < nIn) {
+					int i = int(fracPos);
+					int phase = jmin(phases - 1, int((fracPos - i) * phases + 0.5));
+					if (phase == phases) {
+						phase = 0;
+						i++;
+					}
+					if (i >= nIn) {
+						break;
+					}
+					convolve(&work[(i + hist) * numChans], &bank[phase * taps], out + nOut * numChans);
+					nOut++;
+					fracPos += fracStep;
+				}
+				fracPos -= nIn;
+			}
+
+			std::copy(work.end() - hist * numChans, work.end(), history.begin());
+			return nOut;
+		}
+
+	private:
+		static int64 gcd(int64 a, int64 b) {
+			while (b != 0) {
+				int64 t = a % b;
+				a = b;
+				b = t;
+			}
+			return a;
+		}
+
+		/*
+		* Windowed-sinc lowpass at phases x the input rate, cut off below the lower Nyquist
+		* frequency, stored phase major with taps reversed so convolve() walks forwards
+		*/
+		void design() {
+			const int n = phases * taps;
+			const double cutoff = 0.5 * jmin(1.0, outRate / inRate) * 0.9 / phases;
+			const double centre = (n - 1) / 2.0;
+
+			std::vector<double> proto(n);
+			for (int k = 0; k < n; k++) {
+				double x = k - centre;
+				double sinc = x == 0 ? 2.0 * cutoff : std::sin(2.0 * double_Pi * cutoff * x) / (double_Pi * x);
+				double blackman = 0.42 - 0.5 * std::cos(2.0 * double_Pi * k / (n - 1)) + 0.08 * std::cos(4.0 * double_Pi * k / (n - 1));
+				proto[k] = sinc * blackman * phases;
+			}
+
+			// Phase p uses prototype taps p, p + L, p + 2L, ... against x[i], x[i - 1], ...
+			bank.assign(n, 0.0f);
+			for (int p = 0; p < phases; p++) {
+				double gain = 0;
+				for (int t = 0; t < taps; t++) {
+					gain += proto[p + t * phases];
+				}
+				for (int t = 0; t < taps; t++) {
+					// normalise each phase to unity DC gain
+					bank[p * taps + (taps - 1 - t)] = float(proto[p + t * phases] / gain);
+				}
+			}
+		}
+
+		/*
+		* out[ch] = sum over taps of coeffs[t] * x[t - (taps - 1)][ch], where newest points at x[0]
+		*/
+		void convolve(const float* newest, const float* coeffs, float* dest) const {
+			const float* oldest = newest - (taps - 1) * numChans;
+			for (int ch = 0; ch < numChans; ch++) {
+				dest[ch] = 0.0f;
+			}
+			for (int t = 0; t < taps; t++) {
+				const float c = coeffs[t];
+				const float* src = oldest + t * numChans;
+				for (int ch = 0; ch < numChans; ch++) {
+					dest[ch] += c * src[ch];
+				}
+			}
+		}
+
+		int numChans;
+		double inRate;
+		double outRate;
+
+		int phases;
+		int step;
+		int taps;       // per phase
+		double fracStep;
+		bool rational;
+
+		std::vector<float> bank;
+		std::vector<float> history;
+		std::vector<float> work;
+		int64 phaseAcc;
+		double fracPos;
+
+		JUCE_LEAK_DETECTOR(Resampler);
+	};
+}
+
+#endif // OEP_LSL_RESAMPLER_H_INCLUDED
@@ -5,6 +5,8 @@
 #include "LSLinlet.h"
 #include "LSLinletEditor.h"
 #include "LSLBrainAmp.h"
+#include "XDFPlayback.h"
+#include "FilePlayback.h"
 
 using namespace LSLinletNode;
 
@@ -18,19 +20,76 @@ LSLinlet::LSLinlet(SourceNode* sn) : DataThread(sn),
     num_channels(DEFAULT_NUM_CHANNELS),
     num_samp(DEFAULT_NUM_SAMPLES),
     data_scale(DEFAULT_DATA_SCALE),
-    sample_rate(DEFAULT_SAMPLE_RATE)
+    sample_rate(DEFAULT_SAMPLE_RATE),
+    batch_samples(DEFAULT_BATCH_SAMPLES),
+    batch_delay_ms(DEFAULT_BATCH_DELAY_MS),
+    buffer_seconds(DEFAULT_BUFFER_SECONDS),
+    replay_speed(DEFAULT_REPLAY_SPEED),
+    replay_start(DEFAULT_REPLAY_START),
+    clock_interval(DEFAULT_CLOCK_INTERVAL),
+    clock_max_uncertainty_ms(DEFAULT_CLOCK_MAX_UNCERTAINTY * 1000.0),
+    reorder_ms(DEFAULT_REORDER_MS),
+    reconnect_timeout(DEFAULT_RECONNECT_TIMEOUT),
+    gap_fill(DEFAULT_GAP_FILL),
+    failover_ms(DEFAULT_FAILOVER_MS),
+    inlet_buffer_s(DEFAULT_INLET_BUFFER_S),
+    inlet_buffer_mb(DEFAULT_INLET_BUFFER_MB),
+    inlet_chunk_ms(DEFAULT_INLET_CHUNK_MS),
+    overload_policy(DEFAULT_OVERLOAD_POLICY),
+    overload_ms(DEFAULT_OVERLOAD_MS),
+    irregular_rate(DEFAULT_GRID_RATE),
+    irregular_mode(DEFAULT_IRREGULAR_MODE),
+    decimation(DEFAULT_DECIMATION),
+    dc_cutoff(DEFAULT_DC_CUTOFF),
+    notch_freq(DEFAULT_NOTCH_FREQ),
+    notch_q(DEFAULT_NOTCH_Q),
+    ref_mode(DEFAULT_REF_MODE),
+    ref_channel(1),
+    trigger_channel(DEFAULT_TRIGGER_CHANNEL),
+    ttlState(0),
+    lastTrigger(-1.0f),
+    convbuf(nullptr),
+    tsbuf(nullptr),
+    batchSamps(0),
+    bufferSamples(0),
+    statBatches(0),
+    statBatchSamples(0),
+    statBackupSamples(0),
+    statLatencyUs(0),
+    statMaxLatencyUs(0),
+    statDecimateTicks(0),
+    statDecimateSamples(0),
+    statOverflowSamples(0),
+    statOverflowEvents(0),
+    statOverflowFrom(0),
+    statPeakFill(0),
+    statBlockedTicks(0),
+    overflowing(false),
+    overflowSamplesTotal(0),
+    overflowEventsTotal(0),
+    timerTicks(0),
+    startTicks(0),
+    firstDataTicks(0),
+    startMs(0),
+    cycles(0),
+    dataCycles(0),
+    startMsSum(0), startMsMax(0),
+    firstDataMsSum(0), firstDataMsMax(0),
+    stopMsSum(0), stopMsMax(0)
 
 {
         num_channels = 8;
         num_samp = 100;
         inlet = new LSLinletStream(&sample_rate, &num_channels, num_samp);
-        if (inlet->success) {
-            connected = true;
+        connected = inlet->success;
+
+        // Buffers are needed even without a stream, a replay or a later CONNECT can still provide one
+        batchCapacity = num_samp + batch_samples;
+        bufferSamples = targetBufferSamples();
+        sourceBuffers.add(new DataBuffer(num_channels, bufferSamples));
+        convbuf = (float*)malloc(num_channels * batchCapacity * sizeof(float));
+        tsbuf = (double*)malloc(batchCapacity * sizeof(double));
 
-            sourceBuffers.add(new DataBuffer(num_channels, 10000));
-            convbuf = (float*)malloc(num_channels * num_samp * sizeof(float));
-        }
-    
 }
 
 GenericEditor* LSLinlet::createEditor(SourceNode* sn)
@@ -43,28 +102,71 @@ GenericEditor* LSLinlet::createEditor(SourceNode* sn)
 LSLinlet::~LSLinlet()
 {
     free(convbuf);
+    free(tsbuf);
 }
 
 
 void LSLinlet::resizeChanSamp()
 {
-        sourceBuffers[0]->resize(num_channels, 10000);
-        convbuf = (float*)realloc(convbuf, num_channels * num_samp * sizeof(float));
-        timestamps.resize(num_samp);
-        ttlEventWords.resize(num_samp);
+        // A batch below threshold plus one more pull must always fit
+        batchCapacity = num_samp + batch_samples;
+        batchSamps = 0;
+
+        // The buffer covers the same time span as without decimation, at the reduced rate
+        decimator.configure(getNumChannels(), decimation);
+        ttlState = 0;
+        lastTrigger = -1.0f;
+        triggers.resize(batchCapacity);
+        triggerEdges.clear();
+        carriedEdges.clear();
+        carriedEdges.reserve(batchCapacity);
+        eventCodes.reserve(MARKER_CHUNK);
+        eventCodeInds.reserve(MARKER_CHUNK);
+        carriedCodes.clear();
+        carriedCodeInds.clear();
+        carriedCodes.reserve(MARKER_CHUNK);
+        carriedCodeInds.reserve(MARKER_CHUNK);
+
+        Array<float> gains;
+        StringArray gainTokens = StringArray::fromTokens(channel_gains, ",", "");
+        for (int ch = 0; ch < gainTokens.size(); ch++) {
+            gains.add(gainTokens[ch].trim().isEmpty() ? 1.0f : gainTokens[ch].getFloatValue());
+        }
+        ingestFilter.configure(getNumChannels(), getSampleRate(0), data_scale, gains, dc_cutoff, notch_freq, notch_q);
+        // Auxiliary streams come after the EEG channels and stay out of the common reference
+        const int auxChannels = backend == nullptr ? inlet->getNumAuxChannels() : 0;
+        ingestFilter.setReference(ref_mode, ref_channel - 1, ref_mode == REF_GROUPS ? referenceGroups() : Array<int>(),
+            getNumChannels() - auxChannels);
+        bufferSamples = targetBufferSamples();
+        sourceBuffers[0]->resize(getNumChannels(), bufferSamples);
+        convbuf = (float*)realloc(convbuf, num_channels * batchCapacity * sizeof(float));
+        tsbuf = (double*)realloc(tsbuf, batchCapacity * sizeof(double));
+        timestamps.resize(batchCapacity);
+        ttlEventWords.resize(batchCapacity);
+        for (int i = 0; i < batchCapacity; i++) {
+            ttlEventWords.setUnchecked(i, 0);
+        }
+}
+
+
+int LSLinlet::targetBufferSamples() const
+{
+    // buffer_seconds at the output rate, so decimation shrinks it; never less than two full batches
+    return jmax((int)(buffer_seconds * getSampleRate(0)), 2 * batchCapacity);
 }
 
 
 // These are for other plugins to query the datathread (default OEPlugin functions)
 int LSLinlet::getNumChannels() const
 {
-    return num_channels;
+    // A trigger channel is decoded into TTL words rather than passed on
+    return trigger_channel > 0 && trigger_channel <= num_channels ? num_channels - 1 : num_channels;
 }
 
 int LSLinlet::getNumDataOutputs(DataChannel::DataChannelTypes type, int subproc) const
 {
     if (type == DataChannel::HEADSTAGE_CHANNEL)
-        return num_channels;
+        return getNumChannels();
     else
         return 0; 
 }
@@ -76,7 +178,7 @@ int LSLinlet::getNumTTLOutputs(int subproc) const
 
 float LSLinlet::getSampleRate(int subproc) const
 {
-    return sample_rate;
+    return sample_rate / jmax(1, decimation);
 }
 
 float LSLinlet::getBitVolts (const DataChannel* ch) const
@@ -92,24 +194,190 @@ bool LSLinlet::foundInputSource()
 
 bool LSLinlet::startAcquisition()
 {
+    startTicks = Time::getHighResolutionTicks();
+    firstDataTicks = 0;
+
     // most likely different for each type
     resizeChanSamp();
 
     total_samples = 0;
+    overflowing = false;
+    overflowSamplesTotal = 0;
+    overflowEventsTotal = 0;
+
+    applyClockSettings();
+    inlet->setReorderWindow(reorder_ms / 1000.0);
+    inlet->setReconnect(reconnect_timeout, gap_fill);
+    inlet->setNumSamps(num_samp);
+    inlet->setOverload(overload_policy, overload_ms / 1000.0, overload_log.isNotEmpty() ? File(overload_log) : File());
+
+    // Drops what the still connected inlets buffered while stopped, and sizes their buffers
+    source()->restart();
+    if (backend == nullptr) {
+        if (capture_file.isNotEmpty() && !inlet->startCapture(File(capture_file))) {
+            std::cout << "Could not open capture file " << capture_file << std::endl;
+        }
+        if (xdf_file.isNotEmpty() && !inlet->startRecording(File(xdf_file))) {
+            std::cout << "Could not open XDF file " << xdf_file << std::endl;
+        }
+    }
 
-    startTimer(5000);
+    timerTicks = 0;
+    startTimer(LOG_DRAIN_MS);
 
     startThread();
+
+    startMs = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1000.0;
+    startMsSum += startMs;
+    startMsMax = jmax(startMsMax, startMs);
     return true;
 }
 
 void  LSLinlet::tryToConnect()
 {       
+        if (replay_file.isNotEmpty() || socket_address.isNotEmpty() || shm_name.isNotEmpty()) {
+            connected = openBackend();
+            return;
+        }
         connected = inlet->connectToStream(&sample_rate, &num_channels, num_samp);
+        if (connected && aux_streams.isNotEmpty()) {
+            openAuxStreams();
+        }
+        if (connected && backup_stream.isNotEmpty()) {
+            openBackupStream();
+        }
+}
+
+Array<int> LSLinlet::referenceGroups()
+{
+        Array<int> groups;
+        groups.insertMultiple(0, -1, getNumChannels());
+
+        if (ref_groups.isNotEmpty()) {
+            StringArray groupTokens = StringArray::fromTokens(ref_groups, ";", "");
+            for (int g = 0; g < groupTokens.size(); g++) {
+                StringArray tokens = StringArray::fromTokens(groupTokens[g], ",", "");
+                for (int t = 0; t < tokens.size(); t++) {
+                    String token = tokens[t].trim();
+                    if (token.isEmpty())
+                        continue;
+
+                    int first = token.upToFirstOccurrenceOf("-", false, false).getIntValue();
+                    int last = token.indexOfChar('-') >= 0 ? token.fromFirstOccurrenceOf("-", false, false).getIntValue() : first;
+                    for (int ch = first; ch <= last; ch++) {
+                        if (ch >= 1 && ch <= getNumChannels())
+                            groups.set(ch - 1, g);
+                    }
+                }
+            }
+            return groups;
+        }
+
+        // One group per channel type in the stream metadata
+        StringArray types = backend == nullptr ? inlet->getChannelTypes() : StringArray();
+        if (getNumChannels() < num_channels && trigger_channel <= types.size()) {
+            types.remove(trigger_channel - 1);
+        }
+        StringArray seen;
+        for (int ch = 0; ch < getNumChannels(); ch++) {
+            String type = ch < types.size() ? types[ch] : String();
+            int g = seen.indexOf(type);
+            if (g < 0) {
+                seen.add(type);
+                g = seen.size() - 1;
+            }
+            groups.set(ch, g);
+        }
+        return groups;
+}
+
+void LSLinlet::applyClockSettings()
+{
+        inlet->setClockSync(clock_interval, clock_max_uncertainty_ms / 1000.0);
+}
+
+void LSLinlet::applyGridSettings()
+{
+        if (backend == nullptr) {
+            inlet->setIrregularGrid(irregular_rate, irregular_mode, &sample_rate);
+        }
+}
+
+void LSLinlet::openAuxStreams()
+{
+        if (backend == nullptr && inlet->success) {
+            inlet->openAuxStreams(aux_streams, &num_channels);
+        }
+}
+
+void LSLinlet::openBackupStream()
+{
+        if (backend == nullptr && inlet->success) {
+            inlet->openBackup(backup_stream, failover_ms);
+        }
+}
+
+void LSLinlet::applyBufferSettings()
+{
+        inlet->setBufferBudget(inlet_buffer_s, inlet_buffer_mb, inlet_chunk_ms);
+}
+
+double LSLinlet::getInletFootprint() const
+{
+        return backend == nullptr ? inlet->getBufferFootprint() : 0.0;
+}
+
+int LSLinlet::getInletBuflen() const
+{
+        return inlet->getMaxBuflen();
+}
+
+bool LSLinlet::openBackend()
+{
+        backend = nullptr;
+        if (replay_file.isNotEmpty()) {
+            File file(replay_file);
+            ReplaySource* replay;
+            if (file.hasFileExtension("xdf")) {
+                replay = new XDFPlayback(file, replay_speed);
+            }
+            else if (file.hasFileExtension("npy;dat;bin;raw")) {
+                replay = new FilePlayback(file, replay_speed, num_channels, sample_rate);
+            }
+            else {
+                replay = new CaptureReplay(file, replay_speed);
+            }
+            backend = replay;
+            if (replay->success && replay_start > 0) {
+                replay->seek(replay_start);
+            }
+        }
+        else if (socket_address.isNotEmpty()) {
+            backend = new SocketBackend(socket_address, num_channels, sample_rate);
+        }
+        else if (shm_name.isNotEmpty()) {
+            backend = new ShmBackend(shm_name);
+        }
+        else {
+            return connected = inlet->success;
+        }
+
+        if (!backend->open()) {
+            std::cout << "Could not open " << backend->describe() << std::endl;
+            backend = nullptr;
+            return connected = false;
+        }
+        std::cout << "Acquiring from " << backend->describe() << std::endl;
+
+        sample_rate = backend->sampleRate;
+        num_channels = backend->numChannels;
+        return connected = true;
 }
 
 bool LSLinlet::stopAcquisition()
 {
+    int64 stopTicks = Time::getHighResolutionTicks();
+
     // should always be the same
     if (isThreadRunning())
     {
@@ -119,64 +387,319 @@ bool LSLinlet::stopAcquisition()
     waitForThreadToExit(500);
 
     stopTimer();
+    inlet->drainLog();
+
+    inlet->stopCapture();
+    inlet->stopRecording();
 
     sourceBuffers[0]->clear();
+
+    // Inlets stay connected for the next start; report how long this cycle's transitions took
+    double stopMs = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - stopTicks) * 1000.0;
+    cycles++;
+    stopMsSum += stopMs;
+    stopMsMax = jmax(stopMsMax, stopMs);
+    std::cout << "LSL acquisition " << cycles << ": start " << startMs << " ms, stop " << stopMs << " ms";
+    if (firstDataTicks > 0) {
+        double firstMs = Time::highResolutionTicksToSeconds(firstDataTicks - startTicks) * 1000.0;
+        dataCycles++;
+        firstDataMsSum += firstMs;
+        firstDataMsMax = jmax(firstDataMsMax, firstMs);
+        std::cout << ", first data " << firstMs << " ms";
+    }
+    std::cout << std::endl << "LSL over " << cycles << " acquisitions (mean / max): start "
+        << startMsSum / cycles << " / " << startMsMax << " ms, stop " << stopMsSum / cycles << " / " << stopMsMax << " ms";
+    if (dataCycles > 0) {
+        std::cout << ", first data " << firstDataMsSum / dataCycles << " / " << firstDataMsMax << " ms";
+    }
+    std::cout << std::endl;
+    if (overflowSamplesTotal > 0) {
+        std::cout << "LSL source buffer overflowed " << overflowEventsTotal << " times, "
+            << overflowSamplesTotal << " samples lost" << std::endl;
+    }
     return true;
 }
 
 bool LSLinlet::updateBuffer()
 {
-        // create empty datastructs
-        std::vector<std::vector<float>> recv_buf;
-        std::vector<double> ts_buf;
-        std::vector<std::string> eventVec;
-        std::vector<int> eventIndsArray;
-
-        // Pull data
-        inlet->pullData(&recv_buf, &ts_buf, &eventVec, &eventIndsArray);
-
-        // Add data to convbuf
-        int k = 0;
-        for (int i = 0; i < num_samp; i++) {
-            for (int j = 0; j < num_channels; j++) {
-                float curval = 0.195 * (float)(recv_buf[i][j]);
-                convbuf[k++] = curval; 
-                //std::cout << curval << std::endl;
-            }
-        }
-       
-        // Set timestamps and ttl events
-        int curEvent = 0;
-        for (int i = 0; i < num_samp; i++) {
-            timestamps.set(i, total_samples+i);
-            if (eventIndsArray[i]) {
-                uint64 ttlEvent = std::stoi(eventVec[curEvent++]);
-                if (ttlEvent <= 8) {
-                    ttlEventWords.setUnchecked(i, ttlEvent);
+        // Under the block policy, once the backlog is past the overload threshold, wait for the
+        // signal chain to make room for the pending batch and one more pull instead of
+        // overflowing the source buffer
+        if (overload_policy == OVERLOAD_BLOCK
+            && sourceBuffers[0]->getNumSamples() + batchSamps + num_samp > bufferSamples
+            && source()->overloaded()) {
+            int64 start = Time::getHighResolutionTicks();
+            sleep(1);
+            statBlockedTicks += Time::getHighResolutionTicks() - start;
+            return true;
+        }
+
+        // Pull the next chunk onto the end of the pending batch. While a batch is pending,
+        // only wait as long as its delay budget allows.
+        double waitTime = PULL_TIMEOUT;
+        if (batchSamps > 0) {
+            waitTime = jmax(0.0, batchStart + batch_delay_ms / 1000.0 - lsl::local_clock());
+        }
+
+        // Rows are pulled with all source channels and leave decodeTriggers() at the output width
+        float* dest = convbuf + batchSamps * getNumChannels();
+        int nPulled = source()->pullChunk(dest, tsbuf + batchSamps, num_samp, waitTime, &eventVec, &eventInds);
+        if (backend == nullptr && inlet->getBlockSource() == SOURCE_BACKUP) {
+            statBackupSamples += nPulled;
+        }
+
+        // Markers become TTL codes here: numeric ones come as they are, text is parsed and
+        // anything that is not a number is left out
+        source()->takeNumericMarkers(&eventCodes, &eventCodeInds);
+        for (int e = 0; e < eventVec.size(); e++) {
+            const char* text = eventVec[e].c_str();
+            char* end;
+            long code = std::strtol(text, &end, 10);
+            if (end != text) {
+                eventCodes.push_back((int)code);
+                eventCodeInds.push_back(eventInds[e]);
+            }
+        }
+
+        if (nPulled > 0 && getNumChannels() < num_channels) {
+            decodeTriggers(dest, nPulled);
+        }
+
+        if (nPulled > 0 && decimator.factor() > 1) {
+            // The filter shows an input sample lag input samples later, so markers and trigger
+            // edges move to the output sample at or after theirs plus the lag. Those carried over
+            // from the last chunk, already in output samples, come first; whatever falls past the
+            // end of this chunk is carried to the next one.
+            const int factor = decimator.factor();
+            const int lag = (int)std::ceil(decimator.delay());
+            int first = decimator.firstInput();
+            int64 start = Time::getHighResolutionTicks();
+            int nOut = decimator.process(dest, nPulled, dest);
+            statDecimateTicks += Time::getHighResolutionTicks() - start;
+            statDecimateSamples += nPulled;
+
+            for (int e = 0; e < triggerEdges.size(); e++) {
+                triggerEdges[e].first = (triggerEdges[e].first + lag - first + factor - 1) / factor;
+            }
+            triggerEdges.insert(triggerEdges.begin(), carriedEdges.begin(), carriedEdges.end());
+            carriedEdges.clear();
+
+            for (int e = 0; e < eventCodeInds.size(); e++) {
+                eventCodeInds[e] = (eventCodeInds[e] + lag - first + factor - 1) / factor;
+            }
+            eventCodes.insert(eventCodes.begin(), carriedCodes.begin(), carriedCodes.end());
+            eventCodeInds.insert(eventCodeInds.begin(), carriedCodeInds.begin(), carriedCodeInds.end());
+            carriedCodes.clear();
+            carriedCodeInds.clear();
+
+            int kept = 0;
+            for (int e = 0; e < eventCodes.size(); e++) {
+                if (eventCodeInds[e] < nOut) {
+                    eventCodes[kept] = eventCodes[e];
+                    eventCodeInds[kept++] = eventCodeInds[e];
+                }
+                else {
+                    carriedCodes.push_back(eventCodes[e]);
+                    carriedCodeInds.push_back(eventCodeInds[e] - nOut);
+                }
+            }
+            eventCodes.resize(kept);
+            eventCodeInds.resize(kept);
+            nPulled = nOut;
+        }
+
+        // The trigger state holds between edges; edges past the end of a decimated chunk
+        // are carried to the next one
+        if (getNumChannels() < num_channels) {
+            int e = 0;
+            for (int i = 0; i < nPulled; i++) {
+                while (e < triggerEdges.size() && triggerEdges[e].first <= i) {
+                    ttlState = triggerEdges[e++].second;
+                }
+                ttlEventWords.setUnchecked(batchSamps + i, ttlState);
+            }
+            for (; e < triggerEdges.size(); e++) {
+                carriedEdges.push_back(std::make_pair(triggerEdges[e].first - nPulled, triggerEdges[e].second));
+            }
+            triggerEdges.clear();
+        }
+
+        if (nPulled > 0) {
+            if (batchSamps == 0) {
+                batchStart = lsl::local_clock();
+            }
+
+            ingestFilter.process(dest, nPulled);
+
+            for (int e = 0; e < eventCodes.size(); e++) {
+                if (eventCodes[e] >= 0 && eventCodes[e] <= 8) {
+                    ttlEventWords.setUnchecked(batchSamps + eventCodeInds[e], eventCodes[e]);
+                }
+            }
+
+            batchSamps += nPulled;
+        }
+
+        if (batchSamps == 0) {
+            return true;
+        }
+
+        double now = lsl::local_clock();
+        if (batchSamps >= batch_samples
+            || (now - batchStart) * 1000.0 >= batch_delay_ms
+            || batchSamps + num_samp > batchCapacity) {
+            flushBatch(now);
+        }
+
+    return true;
+}
+
+void LSLinlet::decodeTriggers(float* data, int n)
+{
+        const int srcChans = num_channels;
+        const int outChans = srcChans - 1;
+        const int tc = trigger_channel - 1;
+        float* trig = triggers.data();
+
+        // Take the trigger column out and close the gap, row by row (rows only move down)
+        for (int i = 0; i < n; i++) {
+            const float* src = data + i * srcChans;
+            float* dst = data + i * outChans;
+            trig[i] = src[tc];
+            memmove(dst, src, tc * sizeof(float));
+            memmove(dst + tc, src + tc + 1, (outChans - tc) * sizeof(float));
+        }
+
+        // Branch free count of changes, which vectorizes; most chunks have none
+        int changes = trig[0] != lastTrigger;
+        for (int i = 1; i < n; i++) {
+            changes += trig[i] != trig[i - 1];
+        }
+
+        triggerEdges.clear();
+        if (changes > 0) {
+            float prev = lastTrigger;
+            for (int i = 0; i < n; i++) {
+                if (trig[i] != prev) {
+                    // -1 means no trigger; the value drives the 8 TTL lines
+                    uint64 word = trig[i] < 0 ? 0 : uint64(trig[i]) & 0xFF;
+                    triggerEdges.push_back(std::make_pair(i, word));
+                    prev = trig[i];
                 }
             }
         }
+        lastTrigger = trig[n - 1];
+}
+
+void LSLinlet::flushBatch(double now)
+{
+        if (firstDataTicks == 0) {
+            firstDataTicks = Time::getHighResolutionTicks();
+        }
+        for (int i = 0; i < batchSamps; i++) {
+            timestamps.set(i, total_samples + i);
+        }
 
-        
         int sampswrit = sourceBuffers[0]->addToBuffer(convbuf,
             timestamps.getRawDataPointer(),
             ttlEventWords.getRawDataPointer(),
-            num_samp,
+            batchSamps,
             1);
-        
+
+        // Whatever did not fit is lost; sample numbers still advance past it so the gap shows
+        // in the recording and lines up with the log
+        if (sampswrit < batchSamps) {
+            int64 lost = batchSamps - sampswrit;
+            if (!overflowing) {
+                overflowing = true;
+                overflowEventsTotal++;
+                statOverflowEvents++;
+                statOverflowFrom = total_samples + sampswrit;
+            }
+            overflowSamplesTotal += lost;
+            statOverflowSamples += lost;
+        }
+        else {
+            overflowing = false;
+        }
+        int fill = sourceBuffers[0]->getNumSamples();
+        if (fill > statPeakFill) {
+            statPeakFill = fill;
+        }
+
         // reset ttls. clearQuick() didn't work for whatever reason!
-        for (int i = 0; i < num_samp; i++) {
+        for (int i = 0; i < batchSamps; i++) {
             ttlEventWords.setUnchecked(i, 0);
         }
 
-        //std::cout << "sampswrite: " << sampswrit << std::endl;
-        total_samples += num_samp; // if needed
+        int64 latencyUs = (int64)((now - batchStart) * 1e6);
+        statBatches++;
+        statBatchSamples += batchSamps;
+        statLatencyUs += latencyUs;
+        if (latencyUs > statMaxLatencyUs) {
+            statMaxLatencyUs = latencyUs;
+        }
 
-    return true;
+        total_samples += batchSamps;
+        batchSamps = 0;
 }
 
 void LSLinlet::timerCallback()
 {
+    // The acquisition thread's log is printed here, on the message thread, and statistics
+    // every STATS_INTERVAL_MS
+    inlet->drainLog();
+    if (++timerTicks * LOG_DRAIN_MS < STATS_INTERVAL_MS) {
+        return;
+    }
+    timerTicks = 0;
+
+    int64 batches = statBatches.exchange(0);
+    int64 samples = statBatchSamples.exchange(0);
+    int64 latencyUs = statLatencyUs.exchange(0);
+    int64 maxLatencyUs = statMaxLatencyUs.exchange(0);
+
+    if (batches > 0) {
+        std::cout << "LSL inlet batches: " << batches
+            << ", mean batch size: " << double(samples) / batches << " samples"
+            << ", added latency mean: " << double(latencyUs) / batches / 1000.0 << " ms"
+            << ", max: " << maxLatencyUs / 1000.0 << " ms"
+            << ", source buffer peak " << 100.0 * statPeakFill.exchange(0) / bufferSamples << "% of "
+            << bufferSamples << " samples" << std::endl;
+    }
+
+    int64 fromBackup = statBackupSamples.exchange(0);
+    if (fromBackup > 0) {
+        std::cout << "LSL samples from the backup stream: " << fromBackup << std::endl;
+    }
+
+    int64 blockedTicks = statBlockedTicks.exchange(0);
+    if (blockedTicks > 0) {
+        std::cout << "LSL waited " << Time::highResolutionTicksToSeconds(blockedTicks) * 1000.0
+            << " ms for room in the source buffer" << std::endl;
+    }
+
+    int64 lost = statOverflowSamples.exchange(0);
+    int64 overflows = statOverflowEvents.exchange(0);
+    if (lost > 0) {
+        std::cout << "LSL source buffer overflow: " << lost << " samples lost in " << overflows
+            << " events, latest from sample " << statOverflowFrom << "; the signal chain is not keeping up" << std::endl;
+    }
+
+    int64 decimated = statDecimateSamples.exchange(0);
+    int64 decimateTicks = statDecimateTicks.exchange(0);
+    if (decimated > 0) {
+        double inRate = getNumChannels() * sample_rate * sizeof(float) / 1e6;
+        std::cout << "LSL decimation " << decimation << "x: "
+            << Time::highResolutionTicksToSeconds(decimateTicks) * 1e6 / (getNumChannels() * (decimated / sample_rate))
+            << " us per channel per second of data, signal chain data " << inRate / decimation
+            << " MB/s instead of " << inRate << " MB/s, buffer "
+            << bufferSamples * getNumChannels() * sizeof(float) / 1e6 << " MB instead of "
+            << buffer_seconds * sample_rate * getNumChannels() * sizeof(float) / 1e6 << " MB" << std::endl;
+    }
+
+    source()->printStats();
+
     //std::cout << "Expected samples: " << int(sample_rate * 5) << ", Actual samples: " << total_samples << std::endl;
 
     //relative_sample_rate = (sample_rate * 5) / float(total_samples);
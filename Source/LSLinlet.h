@@ -2,12 +2,35 @@
 #define __EPHYSSOCKETH__
 
 #include <DataThreadHeaders.h>
+#include <atomic>
+#include <cstdlib>
 #include "SocketLSLBrainAmp.h"
+#include "SocketBackend.h"
+#include "ShmBackend.h"
+#include "LSLDecimator.h"
+#include "LSLIngestFilter.h"
 
 const float DEFAULT_SAMPLE_RATE = 30000.0f;
 const float DEFAULT_DATA_SCALE = 0.195f;
 const int DEFAULT_NUM_SAMPLES = 256;
 const int DEFAULT_NUM_CHANNELS = 64;
+const int DEFAULT_BATCH_SAMPLES = 0;
+const float DEFAULT_BATCH_DELAY_MS = 5.0f;
+// Longest a pull blocks, which is also how long stopAcquisition() can wait for the thread
+const double PULL_TIMEOUT = 0.005;
+const float DEFAULT_REPLAY_SPEED = 1.0f;
+const float DEFAULT_REPLAY_START = 0.0f;
+const float DEFAULT_REORDER_MS = 0.0f;
+const int DEFAULT_IRREGULAR_MODE = 0;
+const int DEFAULT_DECIMATION = 1;
+const float DEFAULT_BUFFER_SECONDS = 1.0f;
+// How often the acquisition thread's log is printed, and the statistics
+const int LOG_DRAIN_MS = 100;
+const int STATS_INTERVAL_MS = 5000;
+const float DEFAULT_DC_CUTOFF = 0.0f;
+const float DEFAULT_NOTCH_FREQ = 0.0f;
+const int DEFAULT_REF_MODE = 0;
+const int DEFAULT_TRIGGER_CHANNEL = 0;
 
 namespace LSLinletNode
 {
@@ -36,9 +59,114 @@ namespace LSLinletNode
         int64 total_samples;
         float relative_sample_rate;
 
+        // Batching: received chunks are coalesced into one addToBuffer call until
+        // batch_samples are pending or the oldest pending sample has waited batch_delay_ms
+        int batch_samples;
+        float batch_delay_ms;
+
+        // Seconds of data the source buffer holds for the signal chain, at the output rate
+        float buffer_seconds;
+
+        // Raw traffic capture (empty = off), and playback of a capture or XDF file instead of the live inlet
+        String capture_file;
+        String replay_file;
+        float replay_speed;
+        float replay_start;
+
+        // Framed binary socket to acquire from instead of LSL, "tcp:<port>" or "udp:<port>" (empty = off)
+        String socket_address;
+
+        // Shared memory ring written by a producer on this host, e.g. "/oe_eeg" (empty = off)
+        String shm_name;
+
+        // XDF recording of the raw inlet data (empty = off)
+        String xdf_file;
+
+        // Clock synchronization: seconds between time_correction() probes (0 = off),
+        // and the largest probe round trip uncertainty accepted, in ms
+        float clock_interval;
+        float clock_max_uncertainty_ms;
+
+        // How long data is held back so late markers from another host still land on their sample
+        float reorder_ms;
+
+        // Seconds without EEG data before the stream is resolved again in the background (0 = off),
+        // and how the samples lost meanwhile are filled in (GapFillMode)
+        float reconnect_timeout;
+        int gap_fill;
+
+        // Identical EEG stream (name or source_id) followed as a hot standby (empty = off), and
+        // how long the primary may be quiet before the standby takes over, in ms (0 = from the
+        // primary's chunk interval)
+        String backup_stream;
+        float failover_ms;
+
+        // Inlet buffering budget: longest backlog in seconds, memory cap for all inlets together
+        // in MB (0 = none), and transmission chunk length in ms (0 = one pull)
+        float inlet_buffer_s;
+        float inlet_buffer_mb;
+        float inlet_chunk_ms;
+
+        // What to do when the EEG inlet's backlog passes overload_ms (OverloadPolicy), and a CSV
+        // file every overload is appended to (empty = log only)
+        int overload_policy;
+        float overload_ms;
+        String overload_log;
+
+        // Extra streams (types or names, comma separated), resampled to the EEG rate and
+        // appended after the EEG channels
+        String aux_streams;
+
+        // Grid an irregular rate EEG stream is binned onto, and how bins are filled (BinMode)
+        float irregular_rate;
+        int irregular_mode;
+
+        // Integer factor the stream is decimated by before it enters the signal chain (1 = off);
+        // getSampleRate() reports sample_rate / decimation
+        int decimation;
+
+        // Applied while the data is converted: per-channel gains on top of the scale (comma
+        // separated, missing channels 1), DC blocker corner and line noise notch in Hz (0 = off)
+        String channel_gains;
+        float dc_cutoff;
+        float notch_freq;
+        float notch_q;
+
+        // Re-referencing in the same pass (ReferenceMode): reference channel (1 based) and
+        // groups as channel lists separated by ';' (e.g. "1-32;33-64"), by default channel type
+        int ref_mode;
+        int ref_channel;
+        String ref_groups;
+
+        // Channel (1 based, 0 = none) carrying BrainAmp style triggers: -1, or the trigger value
+        // when it changes. It is decoded into TTL words and removed from the data.
+        int trigger_channel;
+
         void resizeChanSamp();
         void tryToConnect();
 
+        /** Switches the source to replay_file, socket_address or shm_name, or back to the live inlet if both are empty */
+        bool openBackend();
+
+        /** Passes clock_interval and clock_max_uncertainty_ms on to the inlet */
+        void applyClockSettings();
+
+        /** Passes irregular_rate and irregular_mode on to the inlet and updates sample_rate */
+        void applyGridSettings();
+
+        /** Opens the streams in aux_streams and updates num_channels */
+        void openAuxStreams();
+
+        /** Opens backup_stream as the standby for the EEG stream */
+        void openBackupStream();
+
+        /** Passes the inlet buffering budget on to the inlet, which recreates its inlets if needed */
+        void applyBufferSettings();
+
+        /** Worst case memory the inlets can buffer, in bytes, and their backlog limit in seconds */
+        double getInletFootprint() const;
+        int getInletBuflen() const;
+
         GenericEditor* createEditor(SourceNode* sn);
         static DataThread* createDataThread(SourceNode* sn);
 
@@ -47,13 +175,79 @@ namespace LSLinletNode
         bool startAcquisition() override;
         bool stopAcquisition()  override;
         void timerCallback() override;
+        void flushBatch(double now);
+        int targetBufferSamples() const;
+        Array<int> referenceGroups();
+        void decodeTriggers(float* data, int n);
 
 
         bool connected = false;
 
        ScopedPointer<LSLinletStream> inlet;
+       // Replaces the inlet when set
+       ScopedPointer<IngestBackend> backend;
+
+       IngestBackend* source() const { return backend != nullptr ? backend.get() : inlet.get(); }
 
         float *convbuf;
+        double *tsbuf;
+
+        int batchCapacity;
+        int batchSamps;
+        double batchStart;
+        std::vector<std::string> eventVec;
+        std::vector<int> eventInds;
+        // All markers of the current chunk as codes, text ones parsed
+        std::vector<int> eventCodes;
+        std::vector<int> eventCodeInds;
+
+        Decimator decimator;
+        IngestFilter ingestFilter;
+        // Markers and trigger edges that fall past the end of a decimated chunk, indexed from
+        // the start of the next one
+        std::vector<int> carriedCodes;
+        std::vector<int> carriedCodeInds;
+        std::vector<std::pair<int, uint64>> carriedEdges;
+        int bufferSamples;
+
+        std::vector<float> triggers;
+        std::vector<std::pair<int, uint64>> triggerEdges;
+        uint64 ttlState;
+        float lastTrigger;
+
+        // Batch statistics, reset by the timer
+        std::atomic<int64> statBatches;
+        std::atomic<int64> statBatchSamples;
+        std::atomic<int64> statBackupSamples;
+        std::atomic<int64> statLatencyUs;
+        std::atomic<int64> statMaxLatencyUs;
+        std::atomic<int64> statDecimateTicks;
+        std::atomic<int64> statDecimateSamples;
+
+        // Samples the source buffer had no room for, counted in runs of consecutive full
+        // batches (overflow events), the buffer's peak fill, and how long acquisition waited
+        // for room in it; reset by the timer
+        std::atomic<int64> statOverflowSamples;
+        std::atomic<int64> statOverflowEvents;
+        std::atomic<int64> statOverflowFrom;
+        std::atomic<int> statPeakFill;
+        std::atomic<int64> statBlockedTicks;
+        bool overflowing;
+        int64 overflowSamplesTotal;
+        int64 overflowEventsTotal;
+
+        // Timer callbacks since statistics were last printed
+        int timerTicks;
+
+        // Start/stop timing of the current acquisition, and over all acquisitions so far (ms)
+        int64 startTicks;
+        int64 firstDataTicks;
+        double startMs;
+        int cycles;
+        int dataCycles;
+        double startMsSum, startMsMax;
+        double firstDataMsSum, firstDataMsMax;
+        double stopMsSum, stopMsMax;
 
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LSLinlet);
     };
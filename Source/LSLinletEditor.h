@@ -37,11 +37,17 @@ namespace LSLinletNode
         /** Called when label is changed */
         void labelTextChanged(Label* label);
 
+        /** Shows how much memory the inlets' buffers can take */
+        void updateInletFootprint();
+
     private:
 
         // Button that tried to connect to client
         ScopedPointer<UtilityButton> connectButton;
 
+        // Inlet buffer footprint
+        ScopedPointer<Label> inletBufferLabel;
+
         // Buffer size
         ScopedPointer<Label> bufferSizeMainLabel;
 
@@ -64,6 +70,12 @@ namespace LSLinletNode
         ScopedPointer<Label> scaleLabel;
         ScopedPointer<Label> scaleInput;
 
+        // Batching
+        ScopedPointer<Label> batchSizeLabel;
+        ScopedPointer<Label> batchSizeInput;
+        ScopedPointer<Label> batchDelayLabel;
+        ScopedPointer<Label> batchDelayInput;
+
         // Parent node
         LSLinlet* node;
 
@@ -0,0 +1,96 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Log ring
+
+
+Writing to stdout can block for as long as the console takes, which the acquisition thread
+cannot afford. It formats its log lines into a fixed ring of fixed size slots instead, with no
+locks and no allocation, and the message thread prints them. One thread posts, one drains.
+Lines longer than a slot are cut; when the ring is full, lines are dropped and counted.
+*/
+
+#ifndef OEP_LOG_RING_H_INCLUDED
+#define OEP_LOG_RING_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+namespace LSLinletNode
+{
+	const int LOG_RING_SLOTS = 256;
+	const int LOG_LINE_BYTES = 128;
+
+	class LogRing
+	{
+	public:
+		LogRing() : head(0), tail(0), dropped(0) {}
+
+		/*
+		* Queue a printf style line. Only called from the one posting thread.
+		* @return false if the ring was full and the line was dropped
+		*/
+		bool post(const char* format, ...) {
+			const uint32 h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) >= (uint32)LOG_RING_SLOTS) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			va_list args;
+			va_start(args, format);
+			vsnprintf(lines[h % LOG_RING_SLOTS], LOG_LINE_BYTES, format, args);
+			va_end(args);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		/*
+		* Print every queued line. Only called from the one draining thread.
+		*/
+		void drain() {
+			uint32 t = tail.load(std::memory_order_relaxed);
+			const uint32 h = head.load(std::memory_order_acquire);
+			for (; t != h; t++) {
+				std::cout << lines[t % LOG_RING_SLOTS] << std::endl;
+				tail.store(t + 1, std::memory_order_release);
+			}
+			int64 lost = dropped.exchange(0, std::memory_order_relaxed);
+			if (lost > 0) {
+				std::cout << "LSL log: " << lost << " lines dropped, the ring was full" << std::endl;
+			}
+		}
+
+	private:
+		char lines[LOG_RING_SLOTS][LOG_LINE_BYTES];
+		std::atomic<uint32> head;
+		std::atomic<uint32> tail;
+		std::atomic<int64> dropped;
+
+		JUCE_DECLARE_NON_COPYABLE(LogRing);
+	};
+}
+
+#endif // OEP_LOG_RING_H_INCLUDED
@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <PluginInfo.h>
 #include "LSLinlet.h"
+#include "LSLOutlet.h"
+#include "LSLEventOutlet.h"
 #include <string>
 #ifdef WIN32
 #include <Windows.h>
@@ -32,7 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 using namespace Plugin;
-#define NUM_PLUGINS 1
+#define NUM_PLUGINS 3
 
 extern "C" EXPORT void getLibInfo(Plugin::LibraryInfo* info)
 {
@@ -51,6 +53,18 @@ extern "C" EXPORT int getPluginInfo(int index, Plugin::PluginInfo* info)
 		info->dataThread.name = "LSL Inlet";
 		info->dataThread.creator = &createDataThread<LSLinletNode::LSLinlet>;
 		break;
+	case 1:
+		info->type = Plugin::PLUGIN_TYPE_PROCESSOR;
+		info->processor.name = "LSL Outlet";
+		info->processor.type = Plugin::SinkProcessor;
+		info->processor.creator = &(Plugin::createProcessor<LSLOutletNode::LSLOutlet>);
+		break;
+	case 2:
+		info->type = Plugin::PLUGIN_TYPE_PROCESSOR;
+		info->processor.name = "LSL Event Outlet";
+		info->processor.type = Plugin::SinkProcessor;
+		info->processor.creator = &(Plugin::createProcessor<LSLOutletNode::LSLEventOutlet>);
+		break;
 	default:
 		return -1;
 		break;
@@ -0,0 +1,109 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef OEP_REPLAY_SOURCE_H_INCLUDED
+#define OEP_REPLAY_SOURCE_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include "IngestBackend.h"
+
+namespace LSLinletNode
+{
+	/*
+	Paces playback of recorded timestamps against local_clock()
+	*/
+	class ReplayPacer
+	{
+	public:
+		/*
+		* @param speedIn playback speed relative to the recorded timestamps, 0 for as fast as possible
+		*/
+		ReplayPacer(float speedIn) : speed(speedIn), wallStart(-1), firstTs(0) {}
+
+		void restart() {
+			wallStart = -1;
+		}
+
+		/*
+		* Sleep until the sample recorded at ts is due. The first call after restart() is due immediately.
+		* @return false if it is more than timeout seconds away (after sleeping for timeout)
+		*/
+		bool waitFor(double ts, double timeout) {
+			if (wallStart < 0) {
+				wallStart = lsl::local_clock();
+				firstTs = ts;
+			}
+			if (speed <= 0) {
+				return true;
+			}
+			double wait = wallStart + (ts - firstTs) / speed - lsl::local_clock();
+			if (wait > timeout) {
+				Thread::sleep(int(timeout * 1000));
+				return false;
+			}
+			if (wait > 0) {
+				Thread::sleep(int(wait * 1000));
+			}
+			return true;
+		}
+
+	private:
+		float speed;
+		double wallStart;
+		double firstTs;
+	};
+
+	/*
+	A recorded source LSLinlet can acquire from instead of the live inlet.
+	The file is opened on construction.
+	*/
+	class ReplaySource : public IngestBackend
+	{
+	public:
+		ReplaySource(const File& f) : file(f) {}
+
+		bool open() override {
+			return success;
+		}
+
+		String describe() const override {
+			return "replay of " + file.getFileName();
+		}
+
+		/*
+		* Rewind to the start position and restart pacing from now
+		*/
+		void restart() override = 0;
+
+		/*
+		* Move the start position to this many seconds after the first sample
+		*/
+		virtual bool seek(double seconds) { return false; }
+
+	protected:
+		File file;
+	};
+}
+
+#endif // OEP_REPLAY_SOURCE_H_INCLUDED
@@ -0,0 +1,256 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Shared memory backend
+
+
+Reads a ShmRing written by a producer on the same host. Channel count and sample rate come
+from the ring header. Samples are copied once, from the mapped ring straight into the caller's
+buffer; between chunks the thread sleeps on the ring's futex (Linux) or event (Windows), so a
+published block is picked up without polling.
+
+The reader never blocks the producer. If it falls so far behind that the producer's next block
+could overwrite what it reads (the ring capacity less the producer's largest block), those
+samples are skipped and counted as overruns.
+*/
+
+#ifndef OEP_SHM_BACKEND_H_INCLUDED
+#define OEP_SHM_BACKEND_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include "IngestBackend.h"
+#include "ShmRing.h"
+
+namespace LSLinletNode
+{
+	class ShmBackend : public IngestBackend
+	{
+	public:
+		/*
+		* @param nameIn shared memory name the producer created
+		*/
+		ShmBackend(const String& nameIn) :
+			name(nameIn),
+			readIndex(0),
+			markerIndex(0),
+			safeLag(0),
+			samples(0),
+			overruns(0),
+			copyTicks(0),
+			wakeups(0),
+			latencySum(0),
+			latencyMax(0),
+			latencyCount(0)
+		{
+		}
+
+		~ShmBackend() {
+			close();
+		}
+
+		bool open() override {
+			close();
+			if (!region.open(name.toStdString())) {
+				return success = false;
+			}
+			const ShmRingHeader* h = region.header();
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (memcmp(h->magic, SHM_RING_MAGIC, sizeof(SHM_RING_MAGIC)) != 0 || h->numChannels == 0
+				|| h->capacity == 0 || (h->capacity & (h->capacity - 1)) != 0
+				|| region.size() < shmRingBytes(h->numChannels, h->capacity, h->markerCapacity)) {
+				region.unmap();
+				return success = false;
+			}
+			numChannels = h->numChannels;
+			sampleRate = h->sampleRate;
+			// Slots within one producer block of being overwritten may be mid-write
+			safeLag = h->capacity - jlimit<uint64>(1, jmax<uint64>(1, h->capacity / 2), h->maxBlock > 0 ? h->maxBlock : h->capacity / 4);
+			restart();
+			return success = true;
+		}
+
+		String describe() const override {
+			return "shared memory " + name + (success ? ", " + String(numChannels) + " channels at "
+				+ String(sampleRate) + " Hz" : String());
+		}
+
+		void close() override {
+			region.unmap();
+			success = false;
+		}
+
+		void restart() override {
+			// Start at the producer's current position, older samples are not wanted
+			if (region.isOpen()) {
+				readIndex = region.header()->writeIndex.load(std::memory_order_acquire);
+				markerIndex = region.header()->markerWriteIndex.load(std::memory_order_acquire);
+			}
+		}
+
+		int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) override {
+			eventStr->clear();
+			eventInd->clear();
+			if (!region.isOpen()) {
+				return 0;
+			}
+
+			ShmRingHeader* h = region.header();
+			uint64 w = h->writeIndex.load(std::memory_order_acquire);
+			if (w == readIndex) {
+				// Tell the producer we are about to sleep, then check again so a publish in between is not missed
+				uint32 seq = h->seq.load();
+				h->waiting.store(1);
+				w = h->writeIndex.load(std::memory_order_acquire);
+				if (w == readIndex) {
+					region.wait(seq, jmax(1, int(timeout * 1000)));
+					wakeups++;
+					w = h->writeIndex.load(std::memory_order_acquire);
+				}
+				h->waiting.store(0);
+				if (w == readIndex) {
+					return 0;
+				}
+			}
+
+			const uint64 capacity = h->capacity;
+			const uint64 mask = capacity - 1;
+			if (w - readIndex > safeLag) {
+				overruns += w - readIndex - safeLag;
+				readIndex = w - safeLag;
+			}
+
+			int64 start = Time::getHighResolutionTicks();
+			int n = (int)jmin<uint64>(w - readIndex, (uint64)maxSamps);
+			const float* data = region.data();
+			const double* ts = region.timestamps();
+			const uint64 slot = readIndex & mask;
+			const int first = (int)jmin<uint64>((uint64)n, capacity - slot);
+			memcpy(dataBuf, data + slot * numChannels, (size_t)first * numChannels * sizeof(float));
+			memcpy(tsBuf, ts + slot, first * sizeof(double));
+			if (first < n) {
+				memcpy(dataBuf + (size_t)first * numChannels, data, (size_t)(n - first) * numChannels * sizeof(float));
+				memcpy(tsBuf + first, ts, (n - first) * sizeof(double));
+			}
+
+			// The producer may have come within a block of what we copied, those samples may be torn
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64 after = h->writeIndex.load(std::memory_order_relaxed);
+			int dropped = 0;
+			if (after - readIndex > safeLag) {
+				dropped = (int)jmin<uint64>((uint64)n, after - readIndex - safeLag);
+				memmove(dataBuf, dataBuf + (size_t)dropped * numChannels, (size_t)(n - dropped) * numChannels * sizeof(float));
+				memmove(tsBuf, tsBuf + dropped, (n - dropped) * sizeof(double));
+				overruns += dropped;
+			}
+			copyTicks += Time::getHighResolutionTicks() - start;
+			const uint64 base = readIndex + dropped;
+			n -= dropped;
+			readIndex += n + dropped;
+
+			// Samples the producer did not stamp get their arrival time
+			const double now = lsl::local_clock();
+			if (n > 0 && tsBuf[n - 1] == 0) {
+				for (int i = 0; i < n; i++) {
+					tsBuf[i] = now - (w - 1 - (base + i)) / sampleRate;
+				}
+			}
+			else if (n > 0) {
+				double latency = now - tsBuf[n - 1];
+				// Only this thread writes them
+				latencySum.store(latencySum.load() + latency);
+				latencyMax.store(jmax(latencyMax.load(), latency));
+				latencyCount++;
+			}
+			samples += n;
+
+			readMarkers(base, n, eventStr, eventInd);
+			return n;
+		}
+
+		void printStats() override {
+			// The acquisition thread counts while this runs on the message thread
+			const int64 n = samples.exchange(0);
+			const int64 lost = overruns.exchange(0);
+			const int64 ticks = copyTicks.exchange(0);
+			const int64 wakes = wakeups.exchange(0);
+			const int64 latencies = latencyCount.exchange(0);
+			const double sum = latencySum.exchange(0);
+			const double worst = latencyMax.exchange(0);
+			if (n > 0 || lost > 0) {
+				std::cout << "Shared memory " << name << ": samples: " << n
+					<< ", copy: " << (n > 0 ? Time::highResolutionTicksToSeconds(ticks) * 1e6 / n : 0.0) << " us/sample"
+					<< ", overruns: " << lost << ", wakeups: " << wakes;
+				if (latencies > 0) {
+					std::cout << ", latency: " << sum / latencies * 1e3 << " ms mean, "
+						<< worst * 1e3 << " ms max";
+				}
+				std::cout << std::endl;
+			}
+		}
+
+	private:
+		/*
+		* Hand out the markers for samples [base, base + n); markers for overwritten samples land
+		* on the first one, markers for later samples wait
+		*/
+		void readMarkers(uint64 base, int n, std::vector<std::string>* eventStr, std::vector<int>* eventInd) {
+			ShmRingHeader* h = region.header();
+			if (h->markerCapacity == 0) {
+				return;
+			}
+			const uint64 mw = h->markerWriteIndex.load(std::memory_order_acquire);
+			if (mw - markerIndex > h->markerCapacity) {
+				markerIndex = mw - h->markerCapacity;
+			}
+			const ShmMarker* markers = region.markers();
+			for (; markerIndex < mw; markerIndex++) {
+				const ShmMarker& m = markers[markerIndex & (h->markerCapacity - 1)];
+				if (m.sample >= base + n) {
+					break;
+				}
+				eventStr->push_back(std::string(m.text, strnlen(m.text, SHM_MARKER_TEXT)));
+				eventInd->push_back(m.sample > base ? int(m.sample - base) : 0);
+			}
+		}
+
+		String name;
+		ShmRegion region;
+		uint64 readIndex;
+		uint64 markerIndex;
+		uint64 safeLag;     // furthest behind the producer a sample can still be read
+
+		std::atomic<int64> samples;
+		std::atomic<int64> overruns;
+		std::atomic<int64> copyTicks;
+		std::atomic<int64> wakeups;
+		std::atomic<double> latencySum;
+		std::atomic<double> latencyMax;
+		std::atomic<int64> latencyCount;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ShmBackend);
+	};
+}
+
+#endif // OEP_SHM_BACKEND_H_INCLUDED
@@ -0,0 +1,396 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Shared memory sample ring
+
+
+For a producer on the same host (e.g. the amplifier driver) to hand samples to the plugin
+without going through a network stack. The producer creates a named shared memory region and
+writes sample blocks into a ring; the plugin maps the same region and reads them. Only the
+standard library and the OS are used, so a driver can include this header on its own
+(ShmRingWriter); shmstream.py is a Python producer.
+
+Layout, little endian, all offsets in bytes:
+	0    char[8]  magic "OESHMRG1"
+	8    uint32   numChannels
+	12   uint32   capacity, samples (power of two)
+	16   uint32   markerCapacity (power of two)
+	20   uint32   maxBlock, most samples the producer writes before it publishes (0: capacity / 4)
+	24   double   sampleRate
+	32   uint64   writeIndex, samples published so far
+	40   uint64   markerWriteIndex, markers published so far
+	48   uint32   seq, incremented after every publish (the futex word)
+	52   uint32   waiting, set by a reader about to sleep
+	64   double   timestamps[capacity]
+	     float    data[capacity][numChannels]
+	     marker   markers[markerCapacity], 64 bytes each: uint64 sample index, char text[56]
+Sample i is at slot i & (capacity - 1). The producer writes the slots, then stores writeIndex
+(release), bumps seq and wakes a waiting reader: a futex on Linux, a named event
+("<name>_ready") on Windows; elsewhere readers poll. A marker applies to the sample whose
+index it carries, normally the next sample the producer writes.
+While a block is being written its slots hold neither the old nor the new samples, and
+writeIndex does not show it yet, so readers leave the oldest maxBlock slots of the ring alone.
+
+The name is a POSIX shared memory name ("/oe_eeg") or a Windows mapping name.
+*/
+
+#ifndef OEP_SHM_RING_H_INCLUDED
+#define OEP_SHM_RING_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+#endif
+
+namespace LSLinletNode
+{
+	const char SHM_RING_MAGIC[8] = { 'O', 'E', 'S', 'H', 'M', 'R', 'G', '1' };
+	const int SHM_MARKER_BYTES = 64;
+	const int SHM_MARKER_TEXT = SHM_MARKER_BYTES - 8;
+
+	struct ShmRingHeader
+	{
+		char magic[8];
+		uint32_t numChannels;
+		uint32_t capacity;
+		uint32_t markerCapacity;
+		uint32_t maxBlock;
+		double sampleRate;
+		std::atomic<uint64_t> writeIndex;
+		std::atomic<uint64_t> markerWriteIndex;
+		std::atomic<uint32_t> seq;
+		std::atomic<uint32_t> waiting;
+		uint8_t pad[8];
+	};
+	static_assert(sizeof(ShmRingHeader) == 64, "shared memory layout");
+
+	struct ShmMarker
+	{
+		uint64_t sample;
+		char text[SHM_MARKER_TEXT];
+	};
+
+	inline size_t shmRingBytes(uint32_t numChannels, uint32_t capacity, uint32_t markerCapacity) {
+		return sizeof(ShmRingHeader) + (size_t)capacity * sizeof(double)
+			+ (size_t)capacity * numChannels * sizeof(float) + (size_t)markerCapacity * SHM_MARKER_BYTES;
+	}
+
+	/*
+	A mapped ring plus the OS wakeup mechanism, shared by the writer and the reader
+	*/
+	class ShmRegion
+	{
+	public:
+		ShmRegion() : base(nullptr), bytes(0)
+#ifdef _WIN32
+			, mapping(NULL), event(NULL)
+#endif
+		{
+		}
+
+		~ShmRegion() {
+			unmap();
+		}
+
+		/*
+		* Create (or recreate) the region with this size
+		*/
+		bool create(const std::string& nameIn, size_t size) {
+			unmap();
+			name = nameIn;
+#ifdef _WIN32
+			mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+				(DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF), name.c_str());
+			if (mapping == NULL) {
+				return false;
+			}
+			return mapView(size);
+#else
+			int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0666);
+			if (fd < 0) {
+				return false;
+			}
+			bool ok = ftruncate(fd, (off_t)size) == 0 && mapFd(fd, size);
+			close(fd);
+			return ok;
+#endif
+		}
+
+		/*
+		* Map an existing region, its size comes from the header
+		*/
+		bool open(const std::string& nameIn) {
+			unmap();
+			name = nameIn;
+#ifdef _WIN32
+			mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+			if (mapping == NULL || !mapView(sizeof(ShmRingHeader))) {
+				unmap();
+				return false;
+			}
+			const ShmRingHeader* h = header();
+			size_t size = shmRingBytes(h->numChannels, h->capacity, h->markerCapacity);
+			UnmapViewOfFile(base);
+			base = nullptr;
+			return mapView(size);
+#else
+			int fd = shm_open(name.c_str(), O_RDWR, 0666);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat st;
+			bool ok = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ShmRingHeader) && mapFd(fd, (size_t)st.st_size);
+			close(fd);
+			return ok;
+#endif
+		}
+
+		void unmap() {
+#ifdef _WIN32
+			if (base != nullptr) {
+				UnmapViewOfFile(base);
+			}
+			if (mapping != NULL) {
+				CloseHandle(mapping);
+			}
+			if (event != NULL) {
+				CloseHandle(event);
+			}
+			mapping = NULL;
+			event = NULL;
+#else
+			if (base != nullptr) {
+				munmap(base, bytes);
+			}
+#endif
+			base = nullptr;
+			bytes = 0;
+		}
+
+		/*
+		* Remove the name so the region goes away once nobody maps it (writer side)
+		*/
+		void unlink() {
+#ifndef _WIN32
+			shm_unlink(name.c_str());
+#endif
+		}
+
+		/*
+		* Sleep until seq differs from expected or timeoutMs passes
+		*/
+		void wait(uint32_t expected, int timeoutMs) {
+			ShmRingHeader* h = header();
+#if defined(_WIN32)
+			(void)h;
+			(void)expected;
+			WaitForSingleObject(event, (DWORD)timeoutMs);
+#elif defined(__linux__)
+			struct timespec ts;
+			ts.tv_sec = timeoutMs / 1000;
+			ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&h->seq), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+			// No cross-process futex, poll
+			for (int t = 0; t < timeoutMs && h->seq.load() == expected; t++) {
+				usleep(1000);
+			}
+#endif
+		}
+
+		/*
+		* Wake a reader sleeping in wait()
+		*/
+		void wake() {
+#if defined(_WIN32)
+			SetEvent(event);
+#elif defined(__linux__)
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header()->seq), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+		}
+
+		ShmRingHeader* header() const {
+			return (ShmRingHeader*)base;
+		}
+
+		double* timestamps() const {
+			return (double*)(base + sizeof(ShmRingHeader));
+		}
+
+		float* data() const {
+			return (float*)(base + sizeof(ShmRingHeader) + (size_t)header()->capacity * sizeof(double));
+		}
+
+		ShmMarker* markers() const {
+			const ShmRingHeader* h = header();
+			return (ShmMarker*)(base + sizeof(ShmRingHeader) + (size_t)h->capacity * sizeof(double)
+				+ (size_t)h->capacity * h->numChannels * sizeof(float));
+		}
+
+		bool isOpen() const {
+			return base != nullptr;
+		}
+
+		size_t size() const {
+			return bytes;
+		}
+
+	private:
+#ifdef _WIN32
+		bool mapView(size_t size) {
+			base = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+			bytes = size;
+			if (event == NULL) {
+				event = CreateEventA(NULL, FALSE, FALSE, (name + "_ready").c_str());
+			}
+			return base != nullptr && event != NULL;
+		}
+#else
+		bool mapFd(int fd, size_t size) {
+			void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (p == MAP_FAILED) {
+				return false;
+			}
+			base = (uint8_t*)p;
+			bytes = size;
+			return true;
+		}
+#endif
+
+		std::string name;
+		uint8_t* base;
+		size_t bytes;
+#ifdef _WIN32
+		HANDLE mapping;
+		HANDLE event;
+#endif
+	};
+
+	/*
+	Producer side: create the ring, then push sample blocks and markers
+	*/
+	class ShmRingWriter
+	{
+	public:
+		/*
+		* @param capacity ring size in samples, rounded up to a power of two
+		* @param maxBlock most samples written per publish, larger pushes are split; 0 for capacity / 4
+		*/
+		bool create(const std::string& name, uint32_t numChannels, double sampleRate, uint32_t capacity, uint32_t markerCapacity = 256,
+			uint32_t maxBlock = 0) {
+			uint32_t cap = 1;
+			while (cap < capacity) {
+				cap <<= 1;
+			}
+			uint32_t mcap = 1;
+			while (mcap < markerCapacity) {
+				mcap <<= 1;
+			}
+			if (!region.create(name, shmRingBytes(numChannels, cap, mcap))) {
+				return false;
+			}
+			ShmRingHeader* h = region.header();
+			h->numChannels = numChannels;
+			h->capacity = cap;
+			h->markerCapacity = mcap;
+			h->maxBlock = maxBlock > 0 && maxBlock <= cap / 2 ? maxBlock : (cap >= 4 ? cap / 4 : 1);
+			h->sampleRate = sampleRate;
+			h->writeIndex.store(0);
+			h->markerWriteIndex.store(0);
+			h->seq.store(0);
+			h->waiting.store(0);
+			// Magic last, a reader only trusts the header once it is there
+			std::atomic_thread_fence(std::memory_order_release);
+			memcpy(h->magic, SHM_RING_MAGIC, sizeof(SHM_RING_MAGIC));
+			return true;
+		}
+
+		/*
+		* Publish n multiplexed samples; ts are their timestamps (or nullptr, then the reader
+		* stamps them on arrival)
+		*/
+		void push(const float* samples, const double* ts, uint32_t n) {
+			ShmRingHeader* h = region.header();
+			const uint32_t ch = h->numChannels;
+			const uint64_t mask = h->capacity - 1;
+			uint64_t w = h->writeIndex.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < n; i++) {
+				uint64_t slot = (w + i) & mask;
+				memcpy(region.data() + slot * ch, samples + (size_t)i * ch, ch * sizeof(float));
+				region.timestamps()[slot] = ts != nullptr ? ts[i] : 0.0;
+				// Never more than maxBlock unpublished samples, readers keep that far away
+				if ((i + 1) % h->maxBlock == 0 || i + 1 == n) {
+					h->writeIndex.store(w + i + 1, std::memory_order_release);
+					publish();
+				}
+			}
+		}
+
+		/*
+		* Queue a marker for the next sample pushed
+		*/
+		void pushMarker(const std::string& text) {
+			ShmRingHeader* h = region.header();
+			uint64_t m = h->markerWriteIndex.load(std::memory_order_relaxed);
+			ShmMarker* marker = region.markers() + (m & (h->markerCapacity - 1));
+			marker->sample = h->writeIndex.load(std::memory_order_relaxed);
+			size_t len = text.size() < (size_t)SHM_MARKER_TEXT - 1 ? text.size() : SHM_MARKER_TEXT - 1;
+			memcpy(marker->text, text.c_str(), len);
+			marker->text[len] = 0;
+			h->markerWriteIndex.store(m + 1, std::memory_order_release);
+		}
+
+		void close() {
+			region.unlink();
+			region.unmap();
+		}
+
+	private:
+		void publish() {
+			ShmRingHeader* h = region.header();
+			h->seq.fetch_add(1);
+			if (h->waiting.load() != 0) {
+				region.wake();
+			}
+		}
+
+		ShmRegion region;
+	};
+}
+
+#endif // OEP_SHM_RING_H_INCLUDED
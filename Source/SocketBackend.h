@@ -0,0 +1,338 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Framed binary socket backend
+
+
+Receives data over TCP (we listen, one sender at a time) or UDP (one frame per datagram) for
+senders that do not want LSL, e.g. Bonsai or custom acquisition code. The address is
+"tcp:<port>" or "udp:<port>". Channel count and sample rate are set in the editor.
+
+Every frame is a 24 byte little endian header followed by its payload:
+	char[4]  magic "OESF"
+	uint32   type: 0 data, 1 marker
+	uint32   count: samples (data) or bytes of text (marker)
+	uint32   channels (data), must match the configured channel count
+	double   timestamp of the first sample in seconds, 0 to stamp on arrival
+Data payload is count x channels float32, multiplexed (sample major). A marker applies to the
+next sample that arrives after it.
+
+Samples are parsed straight from the receive buffer into the caller's buffer.
+*/
+
+#ifndef OEP_SOCKET_BACKEND_H_INCLUDED
+#define OEP_SOCKET_BACKEND_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include <atomic>
+#include "IngestBackend.h"
+
+namespace LSLinletNode
+{
+	const char SOCKET_FRAME_MAGIC[4] = { 'O', 'E', 'S', 'F' };
+	const int SOCKET_BUFFER_BYTES = 1 << 20;
+	const int SOCKET_MAX_DATAGRAM = 65536;
+
+	enum SocketFrameType
+	{
+		FRAME_DATA = 0,
+		FRAME_MARKER = 1
+	};
+
+	struct SocketFrameHeader
+	{
+		char magic[4];
+		uint32 type;
+		uint32 count;
+		uint32 channels;
+		double timestamp;
+	};
+
+	class SocketBackend : public IngestBackend
+	{
+	public:
+		/*
+		* @param addressIn "tcp:<port>" or "udp:<port>"
+		* @param nChans channels per sample
+		* @param srate sample rate, used for timestamps within a frame
+		*/
+		SocketBackend(const String& addressIn, int nChans, double srate) :
+			address(addressIn),
+			udp(addressIn.startsWith("udp")),
+			port(addressIn.fromFirstOccurrenceOf(":", false, false).getIntValue()),
+			used(0),
+			readPos(0),
+			frameOffset(0),
+			frameTs(0),
+			frames(0),
+			bytes(0),
+			badFrames(0),
+			disconnects(0)
+		{
+			numChannels = nChans;
+			sampleRate = srate;
+			buffer.malloc(SOCKET_BUFFER_BYTES);
+		}
+
+		~SocketBackend() {
+			close();
+		}
+
+		bool open() override {
+			close();
+			if (port <= 0 || numChannels <= 0 || sampleRate <= 0) {
+				return success = false;
+			}
+			if (udp) {
+				datagram = new DatagramSocket();
+				success = datagram->bindToPort(port);
+			}
+			else {
+				listener = new StreamingSocket();
+				success = listener->createListener(port);
+			}
+			if (!success) {
+				close();
+			}
+			return success;
+		}
+
+		String describe() const override {
+			return String(udp ? "UDP" : "TCP") + " port " + String(port) + ", " + String(numChannels)
+				+ " channels at " + String(sampleRate) + " Hz";
+		}
+
+		void close() override {
+			connection = nullptr;
+			listener = nullptr;
+			datagram = nullptr;
+			used = 0;
+			readPos = 0;
+			frameOffset = 0;
+			pendingMarkers.clear();
+		}
+
+		void restart() override {
+			// Drop whatever arrived before acquisition started
+			used = 0;
+			readPos = 0;
+			frameOffset = 0;
+			pendingMarkers.clear();
+		}
+
+		int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) override {
+			eventStr->clear();
+			eventInd->clear();
+
+			const double deadline = lsl::local_clock() + timeout;
+			receive(0.0);
+			int n = parse(dataBuf, tsBuf, maxSamps, eventStr, eventInd);
+			while (n == 0) {
+				double left = deadline - lsl::local_clock();
+				if (left <= 0 || !receive(left)) {
+					break;
+				}
+				n = parse(dataBuf, tsBuf, maxSamps, eventStr, eventInd);
+			}
+			return n;
+		}
+
+		void printStats() override {
+			// The acquisition thread counts while this runs on the message thread
+			const int64 nFrames = frames.exchange(0);
+			const int64 nBytes = bytes.exchange(0);
+			const int64 nBad = badFrames.exchange(0);
+			const int64 nDisconnects = disconnects.exchange(0);
+			if (nFrames > 0 || nBad > 0) {
+				std::cout << "Socket " << describe() << ": frames: " << nFrames
+					<< ", " << nBytes / 1e6 << " MB, bad frames: " << nBad
+					<< ", disconnects: " << nDisconnects << std::endl;
+			}
+		}
+
+	private:
+		/*
+		* Wait up to timeout for bytes and append them to the buffer
+		* @return false if nothing arrived
+		*/
+		bool receive(double timeout) {
+			const int timeoutMs = int(timeout * 1000);
+
+			// Move the unparsed tail to the front so there is room for a whole datagram
+			if (readPos > 0 && SOCKET_BUFFER_BYTES - used < SOCKET_MAX_DATAGRAM) {
+				memmove(buffer.getData(), buffer.getData() + readPos, used - readPos);
+				used -= readPos;
+				readPos = 0;
+			}
+			const int space = SOCKET_BUFFER_BYTES - used;
+			if (space <= 0) {
+				return false;
+			}
+
+			int got = 0;
+			if (udp) {
+				if (datagram == nullptr || datagram->waitUntilReady(true, timeoutMs) != 1) {
+					return false;
+				}
+				got = datagram->read(buffer.getData() + used, space, false);
+			}
+			else {
+				if (listener == nullptr) {
+					return false;
+				}
+				if (connection == nullptr) {
+					if (listener->waitUntilReady(true, timeoutMs) != 1) {
+						return false;
+					}
+					// A new sender starts from scratch, markers the last one left pending included
+					connection = listener->waitForNextConnection();
+					used = 0;
+					readPos = 0;
+					frameOffset = 0;
+					pendingMarkers.clear();
+					return connection != nullptr;
+				}
+				if (connection->waitUntilReady(true, timeoutMs) != 1) {
+					return false;
+				}
+				got = connection->read(buffer.getData() + used, space, false);
+				if (got <= 0) {
+					// Sender went away, wait for the next one
+					connection = nullptr;
+					disconnects++;
+					return false;
+				}
+			}
+
+			if (got <= 0) {
+				return false;
+			}
+			used += got;
+			bytes += got;
+			return true;
+		}
+
+		/*
+		* Copy samples from complete frames in the buffer into dataBuf, up to maxSamps
+		*/
+		int parse(float* dataBuf, double* tsBuf, int maxSamps, std::vector<std::string>* eventStr, std::vector<int>* eventInd) {
+			int n = 0;
+			while (n < maxSamps && used - readPos >= (int)sizeof(SocketFrameHeader)) {
+				const char* frame = buffer.getData() + readPos;
+				SocketFrameHeader header;
+				memcpy(&header, frame, sizeof(header));
+
+				if (memcmp(header.magic, SOCKET_FRAME_MAGIC, 4) != 0) {
+					// Lost sync, skip ahead to the next magic
+					badFrames++;
+					readPos++;
+					while (used - readPos >= 4 && memcmp(buffer.getData() + readPos, SOCKET_FRAME_MAGIC, 4) != 0) {
+						readPos++;
+					}
+					continue;
+				}
+
+				int64 payload = header.type == FRAME_DATA ? (int64)header.count * header.channels * sizeof(float) : header.count;
+				if (sizeof(header) + payload > SOCKET_BUFFER_BYTES - SOCKET_MAX_DATAGRAM) {
+					// Cannot ever fit, drop the header and resync
+					badFrames++;
+					readPos += 4;
+					continue;
+				}
+				if (used - readPos < (int64)sizeof(header) + payload) {
+					break;
+				}
+				const char* body = frame + sizeof(header);
+
+				if (header.type == FRAME_MARKER) {
+					pendingMarkers.push_back(std::string(body, header.count));
+				}
+				else if (header.type == FRAME_DATA && (int)header.channels == numChannels && header.count > 0) {
+					if (frameOffset == 0) {
+						frameTs = header.timestamp != 0 ? header.timestamp
+							: lsl::local_clock() - (header.count - 1) / sampleRate;
+					}
+
+					// Markers received before this frame land on its first sample we hand out
+					for (size_t m = 0; m < pendingMarkers.size(); m++) {
+						eventStr->push_back(pendingMarkers[m]);
+						eventInd->push_back(n);
+					}
+					pendingMarkers.clear();
+
+					int k = jmin(maxSamps - n, (int)header.count - frameOffset);
+					memcpy(dataBuf + n * numChannels, body + (int64)frameOffset * numChannels * sizeof(float),
+						(size_t)k * numChannels * sizeof(float));
+					for (int i = 0; i < k; i++) {
+						tsBuf[n + i] = frameTs + (frameOffset + i) / sampleRate;
+					}
+					n += k;
+					frameOffset += k;
+					if (frameOffset < (int)header.count) {
+						// Caller's buffer is full, the rest of this frame goes out next time
+						break;
+					}
+					frameOffset = 0;
+				}
+				else {
+					badFrames++;
+				}
+
+				frames++;
+				readPos += sizeof(header) + (int)payload;
+			}
+
+			if (readPos == used) {
+				readPos = 0;
+				used = 0;
+			}
+			return n;
+		}
+
+		String address;
+		bool udp;
+		int port;
+
+		ScopedPointer<StreamingSocket> listener;
+		ScopedPointer<StreamingSocket> connection;
+		ScopedPointer<DatagramSocket> datagram;
+
+		HeapBlock<char> buffer;
+		int used;
+		int readPos;
+		int frameOffset;     // samples of the frame at readPos already handed out
+		double frameTs;
+		std::vector<std::string> pendingMarkers;
+
+		std::atomic<int64> frames;
+		std::atomic<int64> bytes;
+		std::atomic<int64> badFrames;
+		std::atomic<int64> disconnects;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SocketBackend);
+	};
+}
+
+#endif // OEP_SOCKET_BACKEND_H_INCLUDED
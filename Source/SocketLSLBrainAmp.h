@@ -42,13 +42,96 @@ else the value corresponding to the value at the trigger input when it changes v
 
 #include <CommonLibHeader.h>
 #include <lsl_cpp.h>
+#include <atomic>
+#include "LSLCapture.h"
+#include "XDFRecorder.h"
+#include "LSLClockSync.h"
+#include "LSLAligner.h"
+#include "LSLResampler.h"
+#include "LSLBinner.h"
+#include "LSLReconnect.h"
+#include "LSLRedundancy.h"
+#include "LSLOverload.h"
+#include "LSLMarkers.h"
+#include "LogRing.h"
+#include "IngestBackend.h"
 
 namespace LSLinletNode
 {
+	// Seconds to look for streams when the plugin is created; CONNECT retries
+	const double RESOLVE_TIMEOUT = 5.0;
+
+	// Seconds to wait for an inlet's connection when it is opened ahead of acquisition
+	const double OPEN_TIMEOUT = 2.0;
+	const double MARKER_LOG_INTERVAL = 1.0;
+
+	// Inlet buffering: longest backlog (max_buflen) in seconds, cap on the memory all inlets
+	// may buffer together in MB (0 = none), and transmission chunk length in ms (0 = pull size)
+	const double DEFAULT_INLET_BUFFER_S = 100.0;
+	const double DEFAULT_INLET_BUFFER_MB = 256.0;
+	const double DEFAULT_INLET_CHUNK_MS = 0.0;
+
+	// Approximate bookkeeping liblsl keeps per buffered sample, and the size assumed for a marker string
+	const int LSL_SAMPLE_OVERHEAD = 48;
+	const int LSL_STRING_BYTES = 64;
+
+	// Clock model ids of the two inlets, auxiliary streams follow
+	enum InletClock
+	{
+		EEG_CLOCK = 0,
+		MARKER_CLOCK = 1,
+		FIRST_AUX_CLOCK = 2
+	};
+
+	/*
+	An extra continuous stream whose channels are appended after the EEG channels,
+	resampled to the EEG rate (or binned onto the EEG samples if it has an irregular rate)
+	so it can share the subprocessor
+	*/
+	struct AuxStream
+	{
+		AuxStream(const lsl::stream_info& infoIn, int32_t maxBuflen, int32_t maxChunklen) :
+			info(infoIn),
+			inlet(infoIn, maxBuflen, maxChunklen),
+			numChans(infoIn.channel_count()),
+			srate(infoIn.nominal_srate()),
+			started(false),
+			underruns(0),
+			ticks(0),
+			samplesIn(0)
+		{
+		}
+
+		lsl::stream_info info;
+		lsl::stream_inlet inlet;
+		int numChans;
+		double srate;
+		Resampler resampler;
+		IrregularBinner binner;
+
+		std::vector<float> pullBuf;
+		std::vector<double> pullTs;
+		std::vector<float> resampled;
+
+		// Resampled samples not yet handed out; outBuf[0] is output sample number outBase
+		std::vector<float> outBuf;
+		int64 outBase;
+		int64 outTotal;
+		double originTs;    // local time of output sample 0
+		int64 inTotal;
+		bool started;
+		std::vector<float> last;
+
+		// Samples held because the stream had nothing for them, and resampling cost
+		int64 underruns;
+		int64 ticks;
+		int64 samplesIn;
+	};
+
 	/*
 	Inlet stream for lsl
 	*/
-	class LSLinletStream
+	class LSLinletStream : public IngestBackend
 	{
 	public:
 		/*
@@ -58,38 +141,46 @@ namespace LSLinletNode
 		* @param nSamps how many samples per buffer pull. Should be equivalent to Open Ephys buffer size (regardless of sampling rate?) Not exactly sure how these interact
 		*/
 		LSLinletStream(float* sr, int* nChans, int nSampsIn):
-			results(lsl::resolve_stream("type", "EEG")),
+			results(),
 			inlet(lsl::stream_inlet(lsl::stream_info())),
-			resultsEvents(lsl::resolve_stream("type", "Markers")),
+			resultsEvents(),
 			inletEvents(lsl::stream_inlet(lsl::stream_info())),
 			initTs(-1)
 		{
-			results = lsl::resolve_stream("type", "EEG");
-			std::cout << "results: " << results[0].name() << std::endl;
+			success = false;
+			nSamps = nSampsIn;
+
+			results = lsl::resolve_stream("type", "EEG", 1, RESOLVE_TIMEOUT);
 			if (results.empty()) {
-				success =  false;
+				return;
 			}
-			*sr = results[0].nominal_srate(); //sampling rate
+			std::cout << "results: " << results[0].name() << std::endl;
 			*nChans = results[0].channel_count();
-			nSamps = nSampsIn;
-			inlet = lsl::stream_inlet(results[0]); //stream_info, num_seconds (we don't want this, skip somehow??), nSamps determined from processor};
+			numChans = *nChans;
+			*sr = configureGrid();
+			sampleRate = *sr;
+			numChannels = *nChans;
+			maxBuflen = computeBuflen();
+			inlet = makeInlet(results[0]);
+			warmUp(inlet);
 
-
-			resultsEvents = lsl::resolve_stream("type", "Markers");
-			std::cout << "resultsEvents: " << resultsEvents[0].name() << std::endl;
+			resultsEvents = lsl::resolve_stream("type", "Markers", 1, RESOLVE_TIMEOUT);
 			if (resultsEvents.empty()) {
-				success = false;
+				return;
 			}
-			inletEvents = lsl::stream_inlet(resultsEvents[0]); //stream_info, num_seconds (we don't want this, skip somehow??), nSamps determined from processor};
+			std::cout << "resultsEvents: " << resultsEvents[0].name() << std::endl;
+			inletEvents = makeInlet(resultsEvents[0]);
+			markers.configure(resultsEvents[0]);
+			warmUp(inletEvents);
 
 			success = true;
+			restartClockSync();
 		}
 		/*
 		* Close stream on exit
 		*/
 		~LSLinletStream() {
-			inlet.close_stream();
-			inletEvents.close_stream();
+			close();
 		}
 
 		bool connectToStream(float *sr, int *nChans, int nSampsIn)
@@ -98,89 +189,1268 @@ namespace LSLinletNode
 			if (results.empty()) {
 				return false;
 			}
-			*sr = results[0].nominal_srate(); //sampling rate
 			*nChans = results[0].channel_count();
+			numChans = *nChans;
 			nSamps = nSampsIn;
-			inlet = lsl::stream_inlet(results[0], 100, nSamps); //stream_info, num_seconds (we don't want this, skip somehow??), nSamps determined from processor
-	
+			*sr = configureGrid();
+			sampleRate = *sr;
+			numChannels = *nChans;
+
+			// The sync thread probes the inlets we are about to replace
+			clockSync.stopThread(3000);
+			maxBuflen = computeBuflen();
+			inlet = makeInlet(results[0]);
+			warmUp(inlet);
+
+			// The marker stream may not have been up when we were created
+			if (resultsEvents.empty()) {
+				resultsEvents = lsl::resolve_stream("type", "Markers");
+				if (resultsEvents.empty()) {
+					return false;
+				}
+				inletEvents = makeInlet(resultsEvents[0]);
+				markers.configure(resultsEvents[0]);
+				warmUp(inletEvents);
+			}
+
+			success = true;
+			restartClockSync();
+			return true;
+		}
+
+		bool open() override {
+			float sr;
+			int nChans;
+			return connectToStream(&sr, &nChans, nSamps);
+		}
+
+		String describe() const override {
+			if (results.empty()) {
+				return "LSL, no stream";
+			}
+			return "LSL stream " + String(results[0].name()) + " (" + String(results[0].type()) + ")";
+		}
+
+		void close() override {
+			resolver.stopThread(3000);
+			clockSync.stopThread(3000);
+			inlet.close_stream();
+			if (backupInlet != nullptr) {
+				backupInlet->close_stream();
+			}
+			inletEvents.close_stream();
+			for (int a = 0; a < auxStreams.size(); a++) {
+				auxStreams[a]->inlet.close_stream();
+			}
+		}
+
+		/*
+		* Inlets stay connected between acquisitions; what they buffered meanwhile is thrown
+		* away so acquisition starts at now, and the pull buffers are sized up front
+		*/
+		void restart() override {
+			flushedOnStart = inlet.flush();
+			flushedOnStart += inletEvents.flush();
+			for (int a = 0; a < auxStreams.size(); a++) {
+				flushedOnStart += auxStreams[a]->inlet.flush();
+			}
+			if (backupInlet != nullptr) {
+				flushedOnStart += backupInlet->flush();
+			}
+			prepare();
+			resetStreams();
+
+			// Supervision starts over, a stall only counts once data has flowed
+			resolver.stopThread(3000);
+			gapFiller.reset();
+			heldCount = 0;
+			lastDataTime = 0;
+			lastAttach = 0;
+			stalled = false;
+
+			overload.reset();
+
+			standby.clear();
+			returning.clear();
+			activeSource = SOURCE_PRIMARY;
+			lastPrimary = lsl::local_clock();
+			haveHandedOut = false;
+		}
+
+		void printStats() override {
+			if (flushedOnStart > 0) {
+				std::cout << "LSL discarded " << flushedOnStart << " samples buffered before acquisition started" << std::endl;
+				flushedOnStart = 0;
+			}
+
+			markers.printStats();
+
+			if (aligner.lateCount() > 0) {
+				std::cout << "LSL markers later than the reorder window: " << aligner.lateCount()
+					<< ", latest by " << aligner.maxLatenessSeconds() * 1000.0 << " ms" << std::endl;
+			}
+			if (aligner.droppedCount() > 0) {
+				std::cout << "LSL samples dropped from a full reorder window: " << aligner.droppedCount() << std::endl;
+			}
+
+			for (int a = 0; a < auxStreams.size(); a++) {
+				const AuxStream* aux = auxStreams[a];
+				if (aux->samplesIn > 0 && aux->srate == lsl::IRREGULAR_RATE) {
+					std::cout << "LSL " << aux->info.name() << ": irregular, binned: " << aux->binner.binnedCount()
+						<< ", empty bins: " << aux->binner.emptyCount()
+						<< ", late samples: " << aux->binner.lateCount() << std::endl;
+				}
+				else if (aux->samplesIn > 0) {
+					double seconds = Time::highResolutionTicksToSeconds(aux->ticks);
+					std::cout << "LSL " << aux->info.name() << ": " << aux->srate << " -> " << sampleRate << " Hz"
+						<< (aux->resampler.isRational() ? " polyphase" : " windowed-sinc")
+						<< ", " << seconds * 1e6 / (aux->numChans * (aux->samplesIn / aux->srate)) << " us per channel per second of data"
+						<< ", held samples: " << aux->underruns << std::endl;
+				}
+			}
+
+			if (backupInlet != nullptr) {
+				// The acquisition thread counts while this runs on the message thread
+				std::cout << "LSL redundancy: blocks from primary: " << blocksFrom[SOURCE_PRIMARY].exchange(0)
+					<< ", from backup: " << blocksFrom[SOURCE_BACKUP].exchange(0) << ", failovers: " << failovers.load()
+					<< ", duplicates dropped: " << duplicates.load() << ", standby overflow: " << standby.droppedCount()
+					<< ", failover after " << failoverDelay.load() * 1000.0 << " ms"
+					<< ", now on " << (activeSource == SOURCE_PRIMARY ? "primary" : "backup") << std::endl;
+			}
+
+			overload.printStats();
+
+			if (reconnects > 0 || stalled) {
+				std::cout << "LSL EEG reconnects: " << reconnects.load() << ", downtime: " << downtime.load() << " s"
+					<< ", gaps filled: " << gapFiller.gapCount() << " (" << gapFiller.filledCount() << " samples)"
+					<< (stalled ? ", stalled now" : "") << std::endl;
+			}
+
+			if (irregular) {
+				std::cout << "LSL EEG irregular, binned: " << eegBinner.binnedCount()
+					<< ", empty bins: " << eegBinner.emptyCount()
+					<< ", late samples: " << eegBinner.lateCount() << std::endl;
+			}
+
+			const char* clockNames[] = { "EEG", "Markers" };
+			for (int c = EEG_CLOCK; c <= MARKER_CLOCK; c++) {
+				ClockModel model = clockSync.getModel(c);
+				if (model.valid) {
+					std::cout << "LSL " << clockNames[c] << " clock offset: " << model.offset * 1000.0 << " ms"
+						<< ", drift: " << model.drift * 1e6 << " ppm"
+						<< ", uncertainty: " << model.uncertainty * 1000.0 << " ms" << std::endl;
+				}
+			}
+		}
+
+		/*
+		* Set the grid irregular rate streams are binned onto. Only changes the rate of an
+		* irregular EEG stream; irregular auxiliary streams are binned onto the EEG samples.
+		* @param rate grid rate in Hz
+		* @param mode one of BinMode
+		* @param sr set to the rate the EEG is delivered at
+		*/
+		void setIrregularGrid(double rate, int mode, float* sr) {
+			gridRate = rate > 0 ? rate : DEFAULT_GRID_RATE;
+			gridMode = mode;
+			if (!results.empty()) {
+				*sr = configureGrid();
+				sampleRate = *sr;
+			}
+		}
+
+		/*
+		* Reconnect supervision for a regular rate EEG stream
+		* @param timeout seconds without data before the stream is resolved again, 0 for never
+		* @param gapMode how the samples lost meanwhile are filled (GapFillMode)
+		*/
+		void setReconnect(double timeout, int gapMode) {
+			reconnectTimeout = timeout;
+			gapFiller.configure(numChans, results.empty() ? 0.0 : results[0].nominal_srate(), gapMode);
+		}
+
+		/*
+		* Handle a growing backlog on the EEG inlet. Only regular rate streams are watched.
+		* @param policy one of OverloadPolicy
+		* @param seconds backlog that counts as an overload
+		* @param logFile CSV file overloads are appended to, or File() for none
+		*/
+		void setOverload(int policy, double seconds, const File& logFile) {
+			const double rate = results.empty() ? 0.0 : results[0].nominal_srate();
+			overload.configure(policy, rate > 0 ? int64(seconds * rate) : 0, logFile, &log);
+		}
+
+		bool overloaded() override {
+			return overload.enabled() && !irregular && overload.check((int64)inlet.samples_available());
+		}
+
+		/*
+		* Follow a second, identical stream as a hot standby for the EEG stream
+		* @param spec name or source_id of the backup stream, empty to stop
+		* @param failoverMs how long the primary may be quiet before the backup takes over, 0 to
+		*                   derive it from the primary's chunk interval
+		* @return true if a matching stream was found
+		*/
+		bool openBackup(const String& spec, double failoverMs) {
+			clockSync.stopThread(3000);
+			backupInlet = nullptr;
+			if (spec.isNotEmpty() && !results.empty() && !irregular) {
+				const double rate = results[0].nominal_srate();
+				autoFailover = failoverMs <= 0;
+				nominalInterval = jmax(nSamps, (int)chunklenFor(results[0])) / rate;
+				primaryInterval = nominalInterval;
+				failoverDelay = autoFailover ? FAILOVER_CHUNKS * nominalInterval : failoverMs / 1000.0;
+
+				// By name or source_id, but never the primary itself
+				const std::string name = spec.toStdString();
+				std::string query = "(name='" + name + "' or source_id='" + name + "') and uid!='" + results[0].uid() + "'";
+				if (!results[0].source_id().empty()) {
+					query += " and source_id!='" + results[0].source_id() + "'";
+				}
+				std::vector<lsl::stream_info> found = lsl::resolve_stream(query, 1, RESOLVE_TIMEOUT);
+				if (found.empty()) {
+					std::cout << "No backup stream " << spec << std::endl;
+				}
+				else if (found[0].channel_count() != numChans || found[0].nominal_srate() != results[0].nominal_srate()) {
+					std::cout << "Backup stream " << spec << " does not match the EEG stream" << std::endl;
+				}
+				else {
+					backupInfo = found[0];
+					backupInlet = new lsl::stream_inlet(backupInfo, maxBuflen, chunklenFor(backupInfo));
+					warmUp(*backupInlet);
+					standby.configure(numChans, jmax(4 * nSamps, int(STANDBY_SECONDS * results[0].nominal_srate())));
+					returning.configure(numChans, jmax(4 * nSamps, int(STANDBY_SECONDS * results[0].nominal_srate())));
+					std::cout << "Backup stream: " << found[0].name() << " on " << found[0].hostname() << ", failover after "
+						<< failoverDelay * 1000.0 << " ms" << (autoFailover ? " (from the chunk interval)" : "") << std::endl;
+				}
+			}
+			rebuildIfBudgetChanged();
+			restartClockSync();
+			return backupInlet != nullptr;
+		}
+
+		/*
+		* Size the inlets' buffers from a latency and memory budget. Inlets are recreated
+		* (they only take the sizes when created) if they exist and a size changed.
+		* @param seconds longest backlog an inlet may hold
+		* @param megabytes cap on what all inlets together may buffer, 0 for none
+		* @param chunkMs transmission chunk length, 0 for the pull size
+		*/
+		void setBufferBudget(double seconds, double megabytes, double chunkMs) {
+			if (seconds == bufferSeconds && megabytes == bufferMegabytes && chunkMs == chunkMillis) {
+				return;
+			}
+			bufferSeconds = seconds;
+			bufferMegabytes = megabytes;
+			chunkMillis = chunkMs;
+			if (success) {
+				clockSync.stopThread(3000);
+				rebuildInlets();
+				restartClockSync();
+			}
+		}
+
+		/*
+		* max_buflen the inlets were created with, in seconds (x100 samples for irregular streams)
+		*/
+		int getMaxBuflen() const {
+			return maxBuflen;
+		}
+
+		/*
+		* Worst case memory the inlets can buffer, in bytes
+		*/
+		double getBufferFootprint() const {
+			if (!success) {
+				return 0;
+			}
+			double bytes = maxBuflen * bytesPerBuflenUnit(results[0]);
+			if (!resultsEvents.empty()) {
+				bytes += maxBuflen * bytesPerBuflenUnit(resultsEvents[0]);
+			}
+			for (int a = 0; a < auxStreams.size(); a++) {
+				bytes += maxBuflen * bytesPerBuflenUnit(auxStreams[a]->info);
+			}
+			if (backupInlet != nullptr) {
+				bytes += maxBuflen * bytesPerBuflenUnit(backupInfo);
+			}
+			return bytes;
+		}
+
+		/*
+		* Which stream the last block handed out came from (BlockSource)
+		*/
+		int getBlockSource() const {
+			return activeSource;
+		}
+
+		/*
+		* Change how often time_correction() is probed (0 turns synchronization off) and the
+		* largest round trip uncertainty a probe may have, both in seconds
+		*/
+		void setClockSync(double interval, double maxUncertainty) {
+			if (interval == clockSync.interval && maxUncertainty == clockSync.maxUncertainty) {
+				return;
+			}
+			clockSync.stopThread(3000);
+			clockSync.interval = interval;
+			clockSync.maxUncertainty = maxUncertainty;
+			restartClockSync();
+		}
+
+		/*
+		* Open extra continuous streams to append after the EEG channels, resampled to the EEG rate
+		* @param spec comma separated stream types (or names if no stream has that type)
+		* @param nChans set to the total channel count
+		* @return number of streams opened
+		*/
+		int openAuxStreams(const String& spec, int* nChans) {
+			clockSync.stopThread(3000);
+			auxStreams.clear();
+			auxChans = 0;
+
+			double eegRate = results.empty() ? 0.0 : irregular ? gridRate : results[0].nominal_srate();
+			StringArray names = StringArray::fromTokens(spec, ",", "");
+			for (int i = 0; i < names.size() && eegRate > 0; i++) {
+				std::string name = names[i].trim().toStdString();
+				if (name.empty()) {
+					continue;
+				}
+				std::vector<lsl::stream_info> found = lsl::resolve_stream("type", name, 1, RESOLVE_TIMEOUT);
+				if (found.empty()) {
+					found = lsl::resolve_stream("name", name, 1, RESOLVE_TIMEOUT);
+				}
+				if (found.empty()) {
+					std::cout << "No stream for " << name << std::endl;
+					continue;
+				}
+
+				AuxStream* aux = auxStreams.add(new AuxStream(found[0], maxBuflen, chunklenFor(found[0])));
+				warmUp(aux->inlet);
+				if (aux->srate == lsl::IRREGULAR_RATE) {
+					aux->binner.configure(aux->numChans, eegRate, gridMode);
+				}
+				else {
+					aux->resampler.configure(aux->numChans, aux->srate, eegRate);
+				}
+				aux->pullBuf.resize(jmax(1024, int(aux->srate)) * aux->numChans);
+				aux->pullTs.resize(aux->pullBuf.size() / aux->numChans);
+				if (aux->srate != lsl::IRREGULAR_RATE) {
+					aux->resampled.resize(aux->resampler.maxOutput((int)aux->pullTs.size()) * aux->numChans);
+				}
+				aux->last.assign(aux->numChans, 0.0f);
+				auxChans += aux->numChans;
+			}
+
+			*nChans = numChans + auxChans;
+			numChannels = *nChans;
+			rebuildIfBudgetChanged();
+			restartClockSync();
+			return auxStreams.size();
+		}
+
+		int getNumAuxChannels() const {
+			return auxChans;
+		}
+
+		// Start the grid and the auxiliary streams over so the next pull re-anchors them
+		void resetStreams() {
+			gridStarted = false;
+			eegBinner.reset();
+			for (int a = 0; a < auxStreams.size(); a++) {
+				auxStreams[a]->binner.reset();
+				auxStreams[a]->started = false;
+				auxStreams[a]->underruns = 0;
+				auxStreams[a]->ticks = 0;
+				auxStreams[a]->samplesIn = 0;
+			}
+		}
+
+		/*
+		* Type of every channel (EEG, then auxiliary streams) from the stream metadata; channels
+		* without one get the type of their stream
+		*/
+		StringArray getChannelTypes() {
+			StringArray types;
+			if (success) {
+				addChannelTypes(inlet, results[0], numChans, types);
+			}
+			for (int a = 0; a < auxStreams.size(); a++) {
+				addChannelTypes(auxStreams[a]->inlet, auxStreams[a]->info, auxStreams[a]->numChans, types);
+			}
+			return types;
+		}
+
+		/*
+		* Hold data back this many seconds so markers arriving late from another host still
+		* land on the right sample. Call before acquisition starts.
+		*/
+		void setReorderWindow(double seconds) {
+			aligner.configure(numChans, results.empty() ? 0.0 : irregular ? gridRate : results[0].nominal_srate(), nSamps, seconds);
+		}
+
+		/*
+		* Start appending everything pulled (raw chunks, LSL timestamps and markers) to a capture file
+		*/
+		bool startCapture(const File& file) {
+			if (results.empty()) {
+				return false;
+			}
+			capture = new CaptureWriter(file, numChans, results[0].nominal_srate());
+			if (!capture->isOpen()) {
+				capture = nullptr;
+				return false;
+			}
 			return true;
 		}
 
+		void stopCapture() {
+			capture = nullptr;
+		}
+
 		/*
-		* Pull most recent buffer of data. Parameters are pointers for data to get written to.
-		* @oaram dataBuf vector<vector> with size = chan x nSamps or nSamps x chan
-		* @param ts vector with size = nSamps
-		*/
-		void pullData(std::vector<std::vector<float>> *dataBuf, std::vector<double> *tsBuf, std::vector<std::string> *eventStr, std::vector<int>*eventIndArray) {
-			//lsl::pull_chunk_multiplexed(dataBuf, tsBuf, nTotalSamps, nTotalSamps) // faster if needed
-			std::vector<std::vector<float>> tempDataBuf(nSamps, std::vector<float>(results[0].channel_count()));
-			std::vector<double> tempTsBuf(nSamps);
-			std::vector<std::string> eventVec = std::vector<std::string>();
-			std::string event;
-			std::vector<int> eventIndsArray(nSamps, 0);
-
-			size_t sampsAv = 0;
-			for (int i = 0; i < nSamps; i++)
-			{
-				tempTsBuf[i] = inlet.pull_sample(tempDataBuf[i]); // this works???
-				if (initTs == -1) {
-					initTs = tempTsBuf[i];
-				}
-				int isEvent = inletEvents.pull_sample(&event, 1, 0.0);
-				if (isEvent != 0) {
-					isEvent = 0;
-					eventVec.push_back(event);
-					//event[i] = 
-					//*eventStr = event;
-					std::cout << "event found: " << event << std::endl;
-					eventIndsArray[i] = 1;
-				}
-				tempTsBuf[i] -= initTs;
-				//inlet.pull_sample(tempDataBuf[i]); // this works???
-				//std::cout << "ts: "  << tempTsBuf[i] << std::endl;
-				//for (int j = 0; j < results[0].channel_count(); j++)
-				//{
-					//std::cout << tempDataBuf[i][j] << std::endl;
-				//}
-				
-			}
-			//std::cout << "looking for events" << std::endl;
-
-			
-			//std::cout << "done looking" << std::endl;
-			//std::cout << "NEW BUFFER" << std::endl;
-			//while (sampsAv == 0) {
-			//	inlet.pull_sample(tempTsBuf); // this works???
-			//	sampsAv = inlet.samples_available();
-			//	std::cout << tempTsBuf[0] << std::endl;
-			//}
-			//inlet.pull_chunk(tempDataBuf, tempTsBuf);
-			*eventStr = eventVec;
-			*eventIndArray = eventIndsArray;
-			*dataBuf = tempDataBuf;
-			*tsBuf = tempTsBuf;
+		* Start recording both streams, with their original timestamps and clock offsets, to an XDF file
+		*/
+		bool startRecording(const File& file) {
+			if (!success) {
+				return false;
+			}
+			recorder = new XDFRecorder(file, inlet.handle(), inletEvents.handle());
+			if (!recorder->isOpen()) {
+				recorder = nullptr;
+				return false;
+			}
+			return true;
+		}
+
+		void stopRecording() {
+			recorder = nullptr;
+		}
+
+		/*
+		* Pull the next chunk of data as the outlet sent it. Blocks up to timeout for the first sample,
+		* then takes whatever else is already queued without waiting. Markers are placed onto the
+		* samples by the aligner; with a reorder window the samples returned are older ones from
+		* its delay line, and there may be none.
+		* @param dataBuf multiplexed buffer with room for maxSamps x channel count values
+		* @param tsBuf buffer with room for maxSamps timestamps
+		* @param maxSamps most samples to return
+		* @param timeout seconds to wait for the first sample
+		* @param eventStr marker strings received with this chunk
+		* @param eventInd sample index (within this chunk) of each marker
+		* @return number of samples written, 0 if the timeout expired
+		*/
+		int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) override {
+			eventStr->clear();
+			eventInd->clear();
+
+			// With auxiliary streams the EEG is widened into dataBuf at the end
+			float* eegBuf = dataBuf;
+			if (auxStreams.size() > 0) {
+				if ((int)eegScratch.size() < maxSamps * numChans) {
+					eegScratch.resize(maxSamps * numChans);
+				}
+				eegBuf = eegScratch.data();
+			}
+
+			int nPulled = irregular ? pullGrid(eegBuf, tsBuf, maxSamps, timeout)
+				: backupInlet != nullptr ? pullRedundant(eegBuf, tsBuf, maxSamps, timeout)
+				: pullSupervised(eegBuf, tsBuf, maxSamps, timeout);
+
+			pullMarkers();
+
+			if (aligner.isDelaying()) {
+				aligner.pushSamples(eegBuf, tsBuf, nPulled);
+				nPulled = aligner.popSamples(eegBuf, tsBuf, maxSamps);
+			}
+			markerCodes.clear();
+			markerCodeInds.clear();
+			aligner.assignMarkers(tsBuf, nPulled, eventStr, eventInd, &markerCodes, &markerCodeInds);
+			if (nPulled == 0) {
+				return 0;
+			}
+			overload.advance(nPulled);
+
+			if (auxStreams.size() > 0) {
+				const int totalChans = numChans + auxChans;
+				for (int i = 0; i < nPulled; i++) {
+					memcpy(dataBuf + i * totalChans, eegBuf + i * numChans, numChans * sizeof(float));
+				}
+				int col = numChans;
+				for (int a = 0; a < auxStreams.size(); a++) {
+					fillAux(auxStreams[a], a, dataBuf, totalChans, col, tsBuf, nPulled);
+					col += auxStreams[a]->numChans;
+				}
+			}
+
+			if (initTs == -1) {
+				initTs = tsBuf[0];
+			}
+			for (int i = 0; i < nPulled; i++) {
+				tsBuf[i] -= initTs;
+			}
+
+			return nPulled;
+		}
+
+		void takeNumericMarkers(std::vector<int>* codes, std::vector<int>* inds) override {
+			codes->clear();
+			inds->clear();
+			codes->swap(markerCodes);
+			inds->swap(markerCodeInds);
+		}
+
+		/*
+		* Print what the acquisition thread logged since the last call; message thread only
+		*/
+		void drainLog() {
+			log.drain();
+			overload.writeLog();
 		}
 
 		/*
 		* Change buffer size of inlet when pulling data
 		* @param nSamps Number of samples per buffer (be sure to change data vector size accordingly)
 		*/
-		void setNumSamps(int nSamps) {
-			//inlet.close_stream();
-			//inlet = lsl::stream_inlet(results[0], 100, nSamps); //stream_info, num_seconds (we don't want this, skip somehow??), nSamps determined from processor
+		void setNumSamps(int nSampsIn) {
+			// The inlet is left alone, max_chunklen only matters to the outlet's sending side
+			nSamps = nSampsIn;
 		}
 
-		bool success;
 
 
 	private:
+		// Connect now rather than on the first pull, so acquisition does not wait for it
+		static void warmUp(lsl::stream_inlet& in) {
+			try {
+				in.open_stream(OPEN_TIMEOUT);
+			}
+			catch (std::exception&) {
+			}
+		}
+
+		// Bytes one unit of max_buflen costs a stream: a second of data, or 100 irregular samples
+		static double bytesPerBuflenUnit(const lsl::stream_info& info) {
+			const int format = info.channel_format();
+			const int valueBytes = format == lsl::cf_string ? LSL_STRING_BYTES
+				: format == lsl::cf_double64 || format == lsl::cf_int64 ? 8
+				: format == lsl::cf_int16 ? 2 : format == lsl::cf_int8 ? 1 : 4;
+			const double samples = info.nominal_srate() == lsl::IRREGULAR_RATE ? 100.0 : info.nominal_srate();
+			return samples * (info.channel_count() * valueBytes + LSL_SAMPLE_OVERHEAD);
+		}
+
+		// Longest backlog in whole seconds that keeps every open stream within the memory budget
+		int computeBuflen() const {
+			double seconds = bufferSeconds;
+			if (bufferMegabytes > 0 && !results.empty()) {
+				double perUnit = bytesPerBuflenUnit(results[0]);
+				if (!resultsEvents.empty()) {
+					perUnit += bytesPerBuflenUnit(resultsEvents[0]);
+				}
+				for (int a = 0; a < auxStreams.size(); a++) {
+					perUnit += bytesPerBuflenUnit(auxStreams[a]->info);
+				}
+				if (backupInlet != nullptr) {
+					perUnit += bytesPerBuflenUnit(backupInfo);
+				}
+				seconds = jmin(seconds, bufferMegabytes * 1e6 / perUnit);
+			}
+			return jmax(1, (int)seconds);
+		}
+
+		// Chunk length for a stream: chunkMillis of its samples, or as long as one pull of the EEG
+		int32_t chunklenFor(const lsl::stream_info& info) const {
+			const double rate = info.nominal_srate();
+			if (rate == lsl::IRREGULAR_RATE) {
+				return 0;
+			}
+			if (chunkMillis > 0) {
+				return jmax(1, (int)std::floor(chunkMillis / 1000.0 * rate + 0.5));
+			}
+			const double eegRate = results.empty() ? 0.0 : results[0].nominal_srate();
+			return eegRate > 0 ? jmax(1, (int)std::floor(nSamps * rate / eegRate + 0.5)) : nSamps;
+		}
+
+		lsl::stream_inlet makeInlet(const lsl::stream_info& info) const {
+			return lsl::stream_inlet(info, maxBuflen, chunklenFor(info));
+		}
+
+		// Opening another stream can lower the backlog the budget allows for all of them
+		void rebuildIfBudgetChanged() {
+			if (success && computeBuflen() != maxBuflen) {
+				rebuildInlets();
+			}
+		}
+
+		// Recreate every inlet with the current sizes; the clock sync thread must be stopped
+		void rebuildInlets() {
+			maxBuflen = computeBuflen();
+			inlet = makeInlet(results[0]);
+			warmUp(inlet);
+			if (!resultsEvents.empty()) {
+				inletEvents = makeInlet(resultsEvents[0]);
+				markers.configure(resultsEvents[0]);
+				warmUp(inletEvents);
+			}
+			for (int a = 0; a < auxStreams.size(); a++) {
+				auxStreams[a]->inlet = makeInlet(auxStreams[a]->info);
+				warmUp(auxStreams[a]->inlet);
+			}
+			if (backupInlet != nullptr) {
+				backupInlet = new lsl::stream_inlet(backupInfo, maxBuflen, chunklenFor(backupInfo));
+				warmUp(*backupInlet);
+			}
+			if (recorder != nullptr) {
+				recorder->replaceInlet(XDFRecorder::EEG_ID, inlet.handle());
+				recorder->replaceInlet(XDFRecorder::MARKER_ID, inletEvents.handle());
+			}
+		}
+
+		// Size every buffer pullChunk may need for nSamps, so the first pulls do not allocate
+		void prepare() {
+			markerCodes.reserve(MARKER_CHUNK);
+			markerCodeInds.reserve(MARKER_CHUNK);
+			if (auxStreams.size() > 0 && (int)eegScratch.size() < nSamps * numChans) {
+				eegScratch.resize(nSamps * numChans);
+			}
+			if (irregular && (int)rawTs.size() < nSamps) {
+				rawBuf.resize(nSamps * numChans);
+				rawTs.resize(nSamps);
+			}
+			if ((int)heldTs.size() < nSamps) {
+				heldBuf.resize(nSamps * numChans);
+				heldTs.resize(nSamps);
+			}
+			if (overload.enabled() && (int)overloadTs.size() < nSamps * OVERLOAD_DECIMATION) {
+				overloadBuf.resize(nSamps * OVERLOAD_DECIMATION * numChans);
+				overloadTs.resize(nSamps * OVERLOAD_DECIMATION);
+			}
+		}
+
+		static void addChannelTypes(lsl::stream_inlet& in, lsl::stream_info& info, int n, StringArray& types) {
+			lsl::stream_info full = in.info(1.0);
+			lsl::xml_element ch = full.desc().child("channels").child("channel");
+			for (int c = 0; c < n; c++) {
+				String type = ch.empty() ? String() : String(ch.child_value("type"));
+				types.add(type.isNotEmpty() ? type : String(info.type()));
+				if (!ch.empty()) {
+					ch = ch.next_sibling("channel");
+				}
+			}
+		}
+
+		/*
+		* Queue every marker waiting on the marker inlet for the aligner. Numeric markers only
+		* become text if they are captured.
+		*/
+		void pullMarkers() {
+			int nMarkers;
+			do {
+				int64 start = Time::getHighResolutionTicks();
+				nMarkers = markers.pull(inletEvents);
+				for (int m = 0; m < nMarkers; m++) {
+					const double eventTs = markers.timestamp(m);
+					if (markers.isNumeric()) {
+						const int code = markers.code(m);
+						if (capture != nullptr) {
+							capture->writeMarker(std::to_string(code), eventTs);
+						}
+						if (recorder != nullptr) {
+							recorder->writeMarker((int32_t)code, eventTs);
+						}
+						aligner.addMarker(code, clockSync.map(MARKER_CLOCK, eventTs));
+						if (markerLogDue()) {
+							char text[16];
+							snprintf(text, sizeof(text), "%d", code);
+							postMarker(text);
+						}
+					}
+					else {
+						const std::string& event = markers.text(m);
+						if (capture != nullptr) {
+							capture->writeMarker(event, eventTs);
+						}
+						if (recorder != nullptr) {
+							recorder->writeMarker(event, eventTs);
+						}
+						aligner.addMarker(event, clockSync.map(MARKER_CLOCK, eventTs));
+						if (markerLogDue()) {
+							postMarker(event.c_str());
+						}
+					}
+				}
+				if (nMarkers > 0) {
+					markers.addIngest(nMarkers, Time::getHighResolutionTicks() - start);
+				}
+			} while (nMarkers == MARKER_CHUNK);
+		}
+
+		/*
+		* Markers are logged one line per MARKER_LOG_INTERVAL at most, the rest only counted
+		* @return true if this marker gets a line
+		*/
+		bool markerLogDue() {
+			const double now = lsl::local_clock();
+			if (now - lastMarkerLog < MARKER_LOG_INTERVAL) {
+				markersUnlogged++;
+				return false;
+			}
+			lastMarkerLog = now;
+			return true;
+		}
+
+		void postMarker(const char* text) {
+			if (markersUnlogged > 0) {
+				log.post("event found: %.60s (and %lld more since the last line)", text, (long long)markersUnlogged);
+			}
+			else {
+				log.post("event found: %.60s", text);
+			}
+			markersUnlogged = 0;
+		}
+
+		/*
+		* Pull up to maxSamps EEG samples, recording them raw and mapping their timestamps into
+		* the local clock domain. Blocks up to timeout for the first one.
+		*/
+		int pullRaw(float* eegBuf, double* tsBuf, int maxSamps, double timeout) {
+			// An overload is handled before the pull: the backlog is dropped, or this pull takes
+			// several times as many samples and averages them down
+			int policy = OVERLOAD_NONE;
+			if (overload.enabled() && !irregular && overload.check((int64)inlet.samples_available())) {
+				policy = overload.getPolicy();
+				if (policy == OVERLOAD_DROP) {
+					dropBacklog(maxSamps);
+					policy = OVERLOAD_NONE;
+				}
+			}
+			float* dst = eegBuf;
+			double* tsDst = tsBuf;
+			int want = maxSamps;
+			if (policy == OVERLOAD_DECIMATE) {
+				want = maxSamps * OVERLOAD_DECIMATION;
+				if ((int)overloadTs.size() < want) {
+					overloadBuf.resize(want * numChans);
+					overloadTs.resize(want);
+				}
+				dst = overloadBuf.data();
+				tsDst = overloadTs.data();
+			}
+
+			double ts = inlet.pull_sample(dst, numChans, timeout);
+			if (ts == 0.0) {
+				return 0;
+			}
+			tsDst[0] = ts;
+
+			int nPulled = 1;
+			if (want > 1) {
+				nPulled += (int)inlet.pull_chunk_multiplexed(dst + numChans, tsDst + 1,
+					(want - 1) * numChans, want - 1, 0.0) / numChans;
+			}
+
+			if (capture != nullptr) {
+				capture->writeChunk(dst, tsDst, nPulled);
+			}
+			if (recorder != nullptr) {
+				recorder->writeChunk(dst, tsDst, nPulled);
+			}
+			if (policy != OVERLOAD_NONE) {
+				overload.affect(tsDst[0], tsDst[nPulled - 1], nPulled);
+			}
+			if (policy == OVERLOAD_DECIMATE) {
+				nPulled = OverloadGuard::decimate(dst, tsDst, nPulled, numChans, OVERLOAD_DECIMATION);
+				memcpy(eegBuf, dst, nPulled * numChans * sizeof(float));
+				memcpy(tsBuf, tsDst, nPulled * sizeof(double));
+			}
+			sentFirstTs = tsBuf[0];
+			sentLastTs = tsBuf[nPulled - 1];
+			clockSync.apply(EEG_CLOCK, tsBuf, nPulled);
+			return nPulled;
+		}
+
+		/*
+		* Discard all but keep samples of the EEG inlet's backlog, oldest first. They still go
+		* into the capture and XDF recording, so the log can be matched against those.
+		*/
+		void dropBacklog(int keep) {
+			if ((int)overloadTs.size() < keep) {
+				overloadBuf.resize(keep * numChans);
+				overloadTs.resize(keep);
+			}
+			int64 toDrop = (int64)inlet.samples_available() - keep;
+			while (toDrop > 0) {
+				const int max = (int)jmin<int64>(toDrop, (int64)overloadTs.size());
+				int n = (int)inlet.pull_chunk_multiplexed(overloadBuf.data(), overloadTs.data(),
+					max * numChans, max, 0.0) / numChans;
+				if (n == 0) {
+					break;
+				}
+				if (capture != nullptr) {
+					capture->writeChunk(overloadBuf.data(), overloadTs.data(), n);
+				}
+				if (recorder != nullptr) {
+					recorder->writeChunk(overloadBuf.data(), overloadTs.data(), n);
+				}
+				overload.affect(overloadTs[0], overloadTs[n - 1], n);
+				toDrop -= n;
+			}
+			overload.finish();
+		}
+
+		/*
+		* pullRaw, watching for the stream going away. After a stall the stream is resolved
+		* again in the background; when data resumes the gap is filled first, and the chunk
+		* that ended it is held back until the fill is out.
+		*/
+		int pullSupervised(float* eegBuf, double* tsBuf, int maxSamps, double timeout) {
+			int n = gapFiller.fill(eegBuf, tsBuf, maxSamps);
+			if (n > 0) {
+				return n;
+			}
+			if (heldCount > 0) {
+				n = jmin(heldCount, maxSamps);
+				memcpy(eegBuf, heldBuf.data(), n * numChans * sizeof(float));
+				memcpy(tsBuf, heldTs.data(), n * sizeof(double));
+				heldCount -= n;
+				memmove(heldBuf.data(), heldBuf.data() + n * numChans, heldCount * numChans * sizeof(float));
+				memmove(heldTs.data(), heldTs.data() + n, heldCount * sizeof(double));
+				gapFiller.note(eegBuf, tsBuf, n);
+				return n;
+			}
+
+			attachResolved();
+			try {
+				n = pullRaw(eegBuf, tsBuf, maxSamps, timeout);
+			}
+			catch (std::exception&) {
+				// Stream lost for good, the resolver will find its replacement
+				Thread::sleep(int(timeout * 1000));
+				n = 0;
+			}
+
+			const double now = lsl::local_clock();
+			if (n == 0) {
+				if (reconnectTimeout > 0 && lastDataTime > 0 && !resolver.isThreadRunning()
+					&& now - jmax(lastDataTime, lastAttach) > reconnectTimeout) {
+					if (!stalled) {
+						log.post("LSL EEG stream stalled, resolving %s again", results[0].name().c_str());
+						stalled = true;
+						sameClock = true;
+					}
+					resolver.search(results[0], maxBuflen, chunklenFor(results[0]));
+				}
+				return 0;
+			}
+
+			if (stalled) {
+				stalled = false;
+				resolver.stopThread(3000);
+				// Only this thread writes it
+				downtime.store(downtime.load() + now - lastDataTime);
+				// Timestamps as sent only compare if the outlet kept its clock; arrival times always do
+				const double gap = sameClock ? sentFirstTs - gapFiller.lastSent()
+					: now - lastDataTime - (n - 1) / results[0].nominal_srate();
+				gapFiller.noteSent(sentLastTs);
+				const int64 fill = gapFiller.begin(gap);
+				if (fill < gapFiller.missingCount()) {
+					log.post("LSL gap of %.1f s only filled for the first %.0f s", gap, MAX_GAP_FILL_SECONDS);
+				}
+				if (fill > 0) {
+					if ((int)heldTs.size() < n) {
+						heldBuf.resize(n * numChans);
+						heldTs.resize(n);
+					}
+					memcpy(heldBuf.data(), eegBuf, n * numChans * sizeof(float));
+					memcpy(heldTs.data(), tsBuf, n * sizeof(double));
+					heldCount = n;
+					lastDataTime = now;
+					return gapFiller.fill(eegBuf, tsBuf, maxSamps);
+				}
+			}
+			lastDataTime = now;
+			gapFiller.note(eegBuf, tsBuf, n);
+			gapFiller.noteSent(sentLastTs);
+			return n;
+		}
+
+		/*
+		* Pull from the primary, keep the backup's samples on standby, and hand out whichever
+		* delivers samples newer than the last one handed out. The primary is waited on no
+		* longer than the failover delay; while the backup is active, the backup is waited on.
+		*/
+		int pullRedundant(float* eegBuf, double* tsBuf, int maxSamps, double timeout) {
+			double now = lsl::local_clock();
+			const bool onBackup = activeSource == SOURCE_BACKUP || now - lastPrimary >= failoverDelay;
+			double wait = onBackup ? 0.0 : jlimit(0.0, timeout, lastPrimary + failoverDelay - now);
+
+			int n = 0;
+			try {
+				n = pullRaw(eegBuf, tsBuf, maxSamps, wait);
+			}
+			catch (std::exception&) {
+				n = 0;
+			}
+			fillStandby(onBackup && n == 0 ? timeout : 0.0);
+			now = lsl::local_clock();
+
+			if (n > 0) {
+				if (autoFailover && lastPrimary > 0 && now - lastPrimary < failoverDelay) {
+					primaryInterval += 0.05 * (now - lastPrimary - primaryInterval);
+					failoverDelay = FAILOVER_CHUNKS * jmax(nominalInterval, primaryInterval);
+				}
+				lastPrimary = now;
+				n = dropHandedOut(eegBuf, tsBuf, n);
+				// A primary coming back after losing samples waits until the standby has covered them
+				const double halfSample = 0.5 / results[0].nominal_srate();
+				if (n > 0 && (returning.size() > 0
+					|| (activeSource == SOURCE_BACKUP && standby.size() > 0 && standby.frontTs() < tsBuf[0] - halfSample))) {
+					returning.append(eegBuf, tsBuf, n);
+					n = 0;
+				}
+				if (n > 0) {
+					handOut(SOURCE_PRIMARY, tsBuf[n - 1]);
+					return n;
+				}
+			}
+
+			if (returning.size() > 0) {
+				n = standby.takeBefore(eegBuf, tsBuf, maxSamps, returning.frontTs() - 0.5 / results[0].nominal_srate());
+				if (n > 0) {
+					handOut(SOURCE_BACKUP, tsBuf[n - 1]);
+					return n;
+				}
+				n = returning.take(eegBuf, tsBuf, maxSamps);
+				handOut(SOURCE_PRIMARY, tsBuf[n - 1]);
+				return n;
+			}
+
+			if (activeSource == SOURCE_BACKUP || now - lastPrimary >= failoverDelay) {
+				n = standby.take(eegBuf, tsBuf, maxSamps);
+				if (n > 0) {
+					handOut(SOURCE_BACKUP, tsBuf[n - 1]);
+				}
+				return n;
+			}
+			return 0;
+		}
+
+		// Append everything the backup has, waiting up to timeout for the first of it
+		void fillStandby(double timeout) {
+			standby.reserve(nSamps);
+			try {
+				int n = 0;
+				if (timeout > 0) {
+					double ts = backupInlet->pull_sample(standby.tailData(), numChans, timeout);
+					if (ts != 0.0) {
+						*standby.tailTs() = ts;
+						n = 1;
+					}
+				}
+				else {
+					n = (int)backupInlet->pull_chunk_multiplexed(standby.tailData(), standby.tailTs(),
+						standby.space() * numChans, standby.space(), 0.0) / numChans;
+				}
+				while (n > 0) {
+					clockSync.apply(backupClock, standby.tailTs(), n);
+					standby.added(n);
+					standby.reserve(nSamps);
+					n = (int)backupInlet->pull_chunk_multiplexed(standby.tailData(), standby.tailTs(),
+						standby.space() * numChans, standby.space(), 0.0) / numChans;
+				}
+			}
+			catch (std::exception&) {
+			}
+			if (haveHandedOut) {
+				standby.trimThrough(lastHandedOut + 0.5 / results[0].nominal_srate());
+			}
+		}
+
+		// Remove samples at or before the last one handed out, they came from the other stream
+		int dropHandedOut(float* eegBuf, double* tsBuf, int n) {
+			if (!haveHandedOut) {
+				return n;
+			}
+			const double limit = lastHandedOut + 0.5 / results[0].nominal_srate();
+			int first = 0;
+			while (first < n && tsBuf[first] <= limit) {
+				first++;
+			}
+			if (first > 0) {
+				duplicates += first;
+				memmove(eegBuf, eegBuf + first * numChans, (n - first) * numChans * sizeof(float));
+				memmove(tsBuf, tsBuf + first, (n - first) * sizeof(double));
+			}
+			return n - first;
+		}
+
+		void handOut(int source, double lastTs) {
+			if (source != activeSource) {
+				failovers++;
+				log.post("LSL switched to the %s stream at %f", source == SOURCE_PRIMARY ? "primary" : "backup", lastTs);
+			}
+			activeSource = source;
+			blocksFrom[source]++;
+			lastHandedOut = lastTs;
+			haveHandedOut = true;
+			standby.trimThrough(lastTs + 0.5 / results[0].nominal_srate());
+		}
+
+		/*
+		* Swap in the inlet the resolver opened on the stream it found. The clock sync thread and
+		* the recorder are handed the new inlet and let go of the old one on their own threads;
+		* the clock model carries over if the stream came back on the same host.
+		*/
+		void attachResolved() {
+			lsl::stream_info found;
+			if (!resolver.take(found)) {
+				return;
+			}
+			if (found.channel_count() != numChans || found.nominal_srate() != results[0].nominal_srate()) {
+				log.post("LSL stream %s came back with a different layout, not reattaching", found.name().c_str());
+				return;
+			}
+			const bool sameHost = found.hostname() == results[0].hostname();
+			sameClock = sameClock && sameHost;
+			results[0] = found;
+			resolver.swapInlet(inlet);
+			clockSync.replaceInlet(EEG_CLOCK, inlet.handle(), sameHost);
+			if (recorder != nullptr) {
+				recorder->replaceInlet(XDFRecorder::EEG_ID, inlet.handle());
+			}
+			lastAttach = lsl::local_clock();
+			reconnects++;
+			log.post("LSL reattached to %s on %s", found.name().c_str(), found.hostname().c_str());
+		}
+
+		/*
+		* Bin an irregular EEG stream onto the grid. Bins are written once they are GRID_LATENCY
+		* old, measured against the local clock shifted by how late samples usually arrive, so
+		* the grid keeps moving while the stream is quiet.
+		*/
+		int pullGrid(float* eegBuf, double* tsBuf, int maxSamps, double timeout) {
+			if ((int)rawTs.size() < maxSamps) {
+				rawBuf.resize(maxSamps * numChans);
+				rawTs.resize(maxSamps);
+			}
+
+			// Wait for samples no longer than until the next bin is due
+			double wait = timeout;
+			if (gridStarted) {
+				double due = gridOrigin + gridIndex / gridRate + arrivalDelay + GRID_LATENCY;
+				wait = jlimit(0.0, timeout, due - lsl::local_clock());
+			}
+
+			int nRaw = pullRaw(rawBuf.data(), rawTs.data(), maxSamps, wait);
+			double now = lsl::local_clock();
+			if (nRaw > 0) {
+				// Smallest recent gap between a sample's timestamp and its arrival; rises slowly
+				// so a clock model that starts or changes is followed
+				double delay = now - rawTs[nRaw - 1];
+				if (!gridStarted) {
+					gridOrigin = rawTs[0];
+					gridIndex = 0;
+					gridStarted = true;
+					arrivalDelay = delay;
+				}
+				arrivalDelay = delay < arrivalDelay ? delay : arrivalDelay + 0.01 * (delay - arrivalDelay);
+				eegBinner.insert(rawBuf.data(), rawTs.data(), nRaw);
+			}
+			if (!gridStarted) {
+				return 0;
+			}
+
+			double horizon = now - arrivalDelay - GRID_LATENCY;
+			int n = 0;
+			while (n < maxSamps && gridOrigin + (gridIndex + n) / gridRate <= horizon) {
+				tsBuf[n] = gridOrigin + (gridIndex + n) / gridRate;
+				n++;
+			}
+			eegBinner.fill(tsBuf, n, eegBuf, numChans);
+			gridIndex += n;
+			return n;
+		}
+
+		// Set up binning if the EEG stream has no regular rate, returns the rate it is delivered at
+		double configureGrid() {
+			irregular = results[0].nominal_srate() == lsl::IRREGULAR_RATE;
+			gridStarted = false;
+			if (!irregular) {
+				return results[0].nominal_srate();
+			}
+			eegBinner.configure(numChans, gridRate, gridMode);
+			return gridRate;
+		}
+
+		/*
+		* Pull everything the auxiliary stream has, resample it, and write the samples matching
+		* the EEG timestamps ts into column col of the widened buffer
+		*/
+		void fillAux(AuxStream* aux, int index, float* dataBuf, int totalChans, int col, const double* ts, int n) {
+			const int ch = aux->numChans;
+			const double outRate = irregular ? gridRate : results[0].nominal_srate();
+
+			if (aux->srate == lsl::IRREGULAR_RATE) {
+				int nIn;
+				while ((nIn = (int)aux->inlet.pull_chunk_multiplexed(aux->pullBuf.data(), aux->pullTs.data(),
+					aux->pullBuf.size(), aux->pullTs.size(), 0.0) / ch) > 0) {
+					clockSync.apply(FIRST_AUX_CLOCK + index, aux->pullTs.data(), nIn);
+					aux->binner.insert(aux->pullBuf.data(), aux->pullTs.data(), nIn);
+					aux->samplesIn += nIn;
+				}
+				aux->binner.fill(ts, n, dataBuf + col, totalChans);
+				return;
+			}
+
+			int64 start = Time::getHighResolutionTicks();
+			int nIn;
+			while ((nIn = (int)aux->inlet.pull_chunk_multiplexed(aux->pullBuf.data(), aux->pullTs.data(),
+				aux->pullBuf.size(), aux->pullTs.size(), 0.0) / ch) > 0) {
+				clockSync.apply(FIRST_AUX_CLOCK + index, aux->pullTs.data(), nIn);
+
+				if (!aux->started) {
+					aux->started = true;
+					aux->originTs = aux->pullTs[0] - aux->resampler.delay() / aux->srate;
+					aux->outBase = 0;
+					aux->outTotal = 0;
+					aux->inTotal = 0;
+					aux->outBuf.clear();
+					aux->resampler.reset();
+				}
+				else {
+					// Slew the origin towards where the stream's own timestamps say it is, so a
+					// rate that is slightly off nominal does not accumulate into misalignment
+					double expected = aux->originTs + (aux->inTotal + aux->resampler.delay()) / aux->srate;
+					aux->originTs += 0.1 * (aux->pullTs[0] - expected);
+				}
+
+				int nOut = aux->resampler.process(aux->pullBuf.data(), nIn, aux->resampled.data());
+				aux->outBuf.insert(aux->outBuf.end(), aux->resampled.begin(), aux->resampled.begin() + nOut * ch);
+				aux->outTotal += nOut;
+				aux->inTotal += nIn;
+				aux->samplesIn += nIn;
+			}
+			aux->ticks += Time::getHighResolutionTicks() - start;
+
+			// Drop resampled samples from before the first EEG sample
+			int available = int(aux->outTotal - aux->outBase);
+			if (aux->started) {
+				int64 first = (int64)std::floor((ts[0] - aux->originTs) * outRate + 0.5);
+				int drop = (int)jlimit((int64)0, (int64)available, first - aux->outBase);
+				if (drop > 0) {
+					memcpy(aux->last.data(), &aux->outBuf[(drop - 1) * ch], ch * sizeof(float));
+					aux->outBuf.erase(aux->outBuf.begin(), aux->outBuf.begin() + drop * ch);
+					aux->outBase += drop;
+					available -= drop;
+				}
+			}
+
+			int used = jmin(n, available);
+			for (int i = 0; i < n; i++) {
+				const float* src = i < used ? &aux->outBuf[i * ch] : aux->last.data();
+				memcpy(dataBuf + i * totalChans + col, src, ch * sizeof(float));
+			}
+			if (used > 0) {
+				memcpy(aux->last.data(), &aux->outBuf[(used - 1) * ch], ch * sizeof(float));
+				aux->outBuf.erase(aux->outBuf.begin(), aux->outBuf.begin() + used * ch);
+				aux->outBase += used;
+			}
+			aux->underruns += n - used;
+		}
+
+		void restartClockSync() {
+			clockSync.stopThread(3000);
+			clockSync.clearInlets();
+			clockSync.addInlet(inlet.handle());
+			clockSync.addInlet(inletEvents.handle());
+			for (int a = 0; a < auxStreams.size(); a++) {
+				clockSync.addInlet(auxStreams[a]->inlet.handle());
+			}
+			if (backupInlet != nullptr) {
+				backupClock = clockSync.addInlet(backupInlet->handle());
+			}
+			if (success && clockSync.interval > 0) {
+				clockSync.startThread();
+			}
+		}
+
 		lsl::stream_inlet inlet;
 		std::vector<lsl::stream_info> results;
 		lsl::stream_inlet inletEvents;
 		std::vector<lsl::stream_info> resultsEvents;
 
+		ScopedPointer<CaptureWriter> capture;
+		ScopedPointer<XDFRecorder> recorder;
+		ClockSync clockSync;
+		StreamAligner aligner;
+
+		bool irregular = false;
+		double gridRate = DEFAULT_GRID_RATE;
+		int gridMode = BIN_HOLD;
+		IrregularBinner eegBinner;
+		bool gridStarted = false;
+		double gridOrigin = 0;
+		int64 gridIndex = 0;
+		double arrivalDelay = 0;
+		std::vector<float> rawBuf;
+		std::vector<double> rawTs;
+
+		StreamResolver resolver;
+		GapFiller gapFiller;
+		double reconnectTimeout = DEFAULT_RECONNECT_TIMEOUT;
+		double lastDataTime = 0;
+		double lastAttach = 0;
+		std::atomic<bool> stalled { false };
+		bool sameClock = true;
+		double sentFirstTs = 0;
+		double sentLastTs = 0;
+		std::vector<float> heldBuf;
+		std::vector<double> heldTs;
+		int heldCount = 0;
+		// Written by the acquisition thread, read by printStats()
+		std::atomic<int64> reconnects { 0 };
+		std::atomic<double> downtime { 0 };
+
+		ScopedPointer<lsl::stream_inlet> backupInlet;
+		lsl::stream_info backupInfo;
+		int backupClock = 0;
+		StandbyBuffer standby;
+		StandbyBuffer returning;    // primary samples waiting for the standby to catch up to them
+		std::atomic<double> failoverDelay { 0 };
+		bool autoFailover = true;
+		double nominalInterval = 0;
+		double primaryInterval = 0;
+		std::atomic<int> activeSource { SOURCE_PRIMARY };
+		double lastPrimary = 0;
+		double lastHandedOut = 0;
+		bool haveHandedOut = false;
+		std::atomic<int64> blocksFrom[2] = { { 0 }, { 0 } };
+		std::atomic<int64> failovers { 0 };
+		std::atomic<int64> duplicates { 0 };
+
+		OwnedArray<AuxStream> auxStreams;
+		int auxChans = 0;
+		std::vector<float> eegScratch;
+
 		int nSamps;
-		float initTs;
+		int numChans;
+		double initTs;
+		int64 flushedOnStart = 0;
+
+		OverloadGuard overload;
+		MarkerArena markers;
+		std::vector<int> markerCodes;
+		std::vector<int> markerCodeInds;
+		double lastMarkerLog = 0;
+		int64 markersUnlogged = 0;
+		LogRing log;
+		std::vector<float> overloadBuf;
+		std::vector<double> overloadTs;
+
+		double bufferSeconds = DEFAULT_INLET_BUFFER_S;
+		double bufferMegabytes = DEFAULT_INLET_BUFFER_MB;
+		double chunkMillis = DEFAULT_INLET_CHUNK_MS;
+		int maxBuflen = (int)DEFAULT_INLET_BUFFER_S;
 
 		JUCE_LEAK_DETECTOR(LSLinletStream);
 	};
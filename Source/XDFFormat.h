@@ -0,0 +1,49 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+XDF constants shared by playback and recording.
+See https://github.com/sccn/xdf/wiki/Specifications for the format.
+*/
+
+#ifndef OEP_XDF_FORMAT_H_INCLUDED
+#define OEP_XDF_FORMAT_H_INCLUDED
+
+#include <CommonLibHeader.h>
+
+namespace LSLinletNode
+{
+	enum XDFTag
+	{
+		XDF_FILE_HEADER = 1,
+		XDF_STREAM_HEADER = 2,
+		XDF_SAMPLES = 3,
+		XDF_CLOCK_OFFSET = 4,
+		XDF_BOUNDARY = 5,
+		XDF_STREAM_FOOTER = 6
+	};
+
+	const uint8 XDF_BOUNDARY_UUID[16] = { 0x43, 0xA5, 0x46, 0xDC, 0xCB, 0xF5, 0x41, 0x0F, 0xB3, 0x0E, 0xD5, 0x46, 0x73, 0x83, 0xCB, 0xE4 };
+}
+
+#endif // OEP_XDF_FORMAT_H_INCLUDED
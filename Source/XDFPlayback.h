@@ -0,0 +1,548 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+XDF playback
+
+
+Plays the first EEG stream (or the first numeric stream if none is typed EEG) and the first
+Markers stream of an XDF file, as recorded by LabRecorder. The file is memory mapped. Opening
+walks the chunk headers and reads every stream header, wherever it is in the file; the index of
+sample chunks is built on the first restart or seek, from chunk headers alone.
+
+Timestamps are mapped into the recorder's clock with the ClockOffset chunks of their stream: a
+straight line (offset and drift) fitted through all of them, as for a live inlet. Markers then go
+through the StreamAligner like live ones, so they land on the same sample they would have live.
+
+Every length read from the file is checked against the mapped size, so a truncated or corrupt
+file plays up to its last complete chunk, and a sample that overruns its chunk ends that chunk.
+*/
+
+#ifndef OEP_XDF_PLAYBACK_H_INCLUDED
+#define OEP_XDF_PLAYBACK_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include "LSLAligner.h"
+#include "LSLClockSync.h"
+#include "ReplaySource.h"
+#include "XDFFormat.h"
+
+namespace LSLinletNode
+{
+	struct XDFStream
+	{
+		uint32 id;
+		String type;
+		String format;
+		int channelCount;
+		double srate;
+		int valueBytes; // 0 for strings
+	};
+
+	struct XDFChunk
+	{
+		int64 content; // first byte after the stream id
+		int64 end;
+		double firstTs;
+	};
+
+	/*
+	Cursor over the samples of one stream
+	*/
+	struct XDFCursor
+	{
+		size_t chunk;
+		int64 pos;
+		int64 end;
+		int64 remaining;
+		double lastTs;
+	};
+
+	class XDFPlayback : public ReplaySource
+	{
+	public:
+		/*
+		* @param f XDF file
+		* @param speed playback speed relative to the recorded timestamps, 0 for as fast as possible
+		*/
+		XDFPlayback(const File& f, float speed) :
+			ReplaySource(f),
+			map(f, MemoryMappedFile::readOnly),
+			pacer(speed),
+			indexed(false),
+			startOffset(0)
+		{
+			base = (const uint8*)map.getData();
+			size = (int64)map.getSize();
+			if (base == nullptr || size < 4 || memcmp(base, "XDF:", 4) != 0) {
+				return;
+			}
+
+			// Writers may add a stream header after samples of other streams, so look at every chunk
+			int64 pos = 4;
+			int64 content, end;
+			uint16 tag;
+			while (nextChunk(pos, tag, content, end)) {
+				if (tag == XDF_STREAM_HEADER) {
+					addStream(content, end);
+				}
+			}
+
+			for (int i = 0; i < (int)streams.size(); i++) {
+				if (eeg < 0 && streams[i].valueBytes > 0 && streams[i].type.equalsIgnoreCase("EEG")) {
+					eeg = i;
+				}
+				if (markers < 0 && streams[i].type.equalsIgnoreCase("Markers")) {
+					markers = i;
+				}
+			}
+			for (int i = 0; eeg < 0 && i < (int)streams.size(); i++) {
+				if (streams[i].valueBytes > 0 && streams[i].srate > 0) {
+					eeg = i;
+				}
+			}
+			if (eeg < 0) {
+				return;
+			}
+
+			numChannels = streams[eeg].channelCount;
+			sampleRate = streams[eeg].srate;
+			aligner.configure(numChannels, sampleRate, 0, 0.0);
+			success = true;
+		}
+
+		void restart() override {
+			buildIndex();
+
+			data = openCursor(eegChunks);
+			marker = openCursor(markerChunks);
+			pendingMarker = false;
+			aligner.reset();
+			pacer.restart();
+			initTs = -1;
+
+			if (startOffset > 0 && !eegChunks.empty()) {
+				double target = eegChunks[0].firstTs + startOffset;
+
+				// Jump to the last chunk starting before the target, then step through samples
+				size_t c = 0;
+				while (c + 1 < eegChunks.size() && eegChunks[c + 1].firstTs <= target) {
+					c++;
+				}
+				data = openCursor(eegChunks, c);
+				double ts;
+				while (peekTimestamp(eegChunks, data, streams[eeg], ts) && ts < target) {
+					skipSample(eegChunks, data, streams[eeg]);
+				}
+
+				std::string text;
+				const double markerTarget = eegClock.map(target);
+				while (nextMarker(text, ts) && ts < markerTarget) {
+					pendingMarker = false;
+				}
+			}
+		}
+
+		bool seek(double seconds) override {
+			startOffset = seconds;
+			restart();
+			return true;
+		}
+
+		int pullChunk(float *dataBuf, double *tsBuf, int maxSamps, double timeout, std::vector<std::string> *eventStr, std::vector<int> *eventInd) override {
+			eventStr->clear();
+			eventInd->clear();
+			buildIndex();
+
+			const XDFStream& stream = streams[eeg];
+			double ts;
+			if (!peekTimestamp(eegChunks, data, stream, ts)) {
+				Thread::sleep(int(timeout * 1000));
+				return 0;
+			}
+			if (!pacer.waitFor(ts, timeout)) {
+				return 0;
+			}
+
+			// One recorded chunk at most, like a pull from the live inlet
+			int nPulled = 0;
+			while (nPulled < maxSamps && data.remaining > 0 && sampleFits(data, stream)) {
+				tsBuf[nPulled] = eegClock.map(readTimestamp(data, stream));
+				readSample(data, stream, dataBuf + nPulled * numChannels);
+				nPulled++;
+			}
+
+			// Markers up to the last sample are due, later ones wait in the file
+			std::string text;
+			while (nextMarker(text, ts) && ts <= tsBuf[nPulled - 1]) {
+				aligner.addMarker(text, ts);
+				pendingMarker = false;
+			}
+			aligner.assignMarkers(tsBuf, nPulled, eventStr, eventInd, &markerCodes, &markerCodeInds);
+
+			if (initTs == -1) {
+				initTs = tsBuf[0];
+			}
+			for (int i = 0; i < nPulled; i++) {
+				tsBuf[i] -= initTs;
+			}
+
+			return nPulled;
+		}
+
+	private:
+		/*
+		* Read a variable length integer that must end by limit
+		* @return false if it does not, or its size byte is not 1, 4 or 8
+		*/
+		bool readVarLen(int64& pos, int64 limit, int64& value) const {
+			if (pos >= limit) {
+				return false;
+			}
+			const uint8 nBytes = base[pos];
+			if ((nBytes != 1 && nBytes != 4 && nBytes != 8) || pos + 1 + nBytes > limit) {
+				return false;
+			}
+			uint64 raw = 0;
+			memcpy(&raw, base + pos + 1, nBytes);
+			if ((int64)raw < 0) {
+				return false;
+			}
+			value = (int64)raw;
+			pos += 1 + nBytes;
+			return true;
+		}
+
+		/*
+		* Step to the next chunk. Stops at the first one that would run past the end of the file.
+		* @param pos start of the chunk, moved to the start of the next one
+		* @param content, end its content after the tag
+		*/
+		bool nextChunk(int64& pos, uint16& tag, int64& content, int64& end) const {
+			int64 p = pos;
+			int64 len;
+			if (!readVarLen(p, size, len) || len < (int64)sizeof(uint16) || len > size - p) {
+				return false;
+			}
+			end = p + len;
+			tag = readValue<uint16>(p);
+			content = p;
+			pos = end;
+			return true;
+		}
+
+		template <typename T>
+		T readValue(int64& pos) const {
+			T value;
+			memcpy(&value, base + pos, sizeof(T));
+			pos += sizeof(T);
+			return value;
+		}
+
+		void addStream(int64 pos, int64 end) {
+			if (end - pos < (int64)sizeof(uint32)) {
+				return;
+			}
+			XDFStream stream;
+			stream.id = readValue<uint32>(pos);
+
+			ScopedPointer<XmlElement> xml = XmlDocument::parse(String((const char*)(base + pos), end - pos));
+			if (xml == nullptr) {
+				return;
+			}
+			XmlElement* type = xml->getChildByName("type");
+			XmlElement* format = xml->getChildByName("channel_format");
+			XmlElement* count = xml->getChildByName("channel_count");
+			XmlElement* srate = xml->getChildByName("nominal_srate");
+			if (format == nullptr || count == nullptr) {
+				return;
+			}
+
+			stream.type = type != nullptr ? type->getAllSubText().trim() : String();
+			stream.format = format->getAllSubText().trim();
+			stream.channelCount = count->getAllSubText().getIntValue();
+			stream.srate = srate != nullptr ? srate->getAllSubText().getDoubleValue() : 0.0;
+
+			if (stream.channelCount <= 0) {
+				return;
+			}
+			if (stream.format == "float32" || stream.format == "int32") stream.valueBytes = 4;
+			else if (stream.format == "double64" || stream.format == "int64") stream.valueBytes = 8;
+			else if (stream.format == "int16") stream.valueBytes = 2;
+			else if (stream.format == "int8") stream.valueBytes = 1;
+			else stream.valueBytes = 0;
+
+			streams.push_back(stream);
+		}
+
+		/*
+		* Walks every chunk header once and records where each sample chunk of our streams lives
+		*/
+		void buildIndex() {
+			if (indexed) {
+				return;
+			}
+			indexed = true;
+
+			uint32 eegId = streams[eeg].id;
+			uint32 markerId = markers >= 0 ? streams[markers].id : 0;
+			std::vector<double> eegOffsets, markerOffsets;
+
+			int64 pos = 4;
+			int64 content, end;
+			uint16 tag;
+			while (nextChunk(pos, tag, content, end)) {
+				if (tag == XDF_CLOCK_OFFSET && end - content >= (int64)(sizeof(uint32) + 2 * sizeof(double))) {
+					int64 p = content;
+					uint32 id = readValue<uint32>(p);
+					if (id == eegId || (markers >= 0 && id == markerId)) {
+						std::vector<double>& offsets = id == eegId ? eegOffsets : markerOffsets;
+						offsets.push_back(readValue<double>(p));
+						offsets.push_back(readValue<double>(p));
+					}
+					continue;
+				}
+				if (tag != XDF_SAMPLES || end - content < (int64)sizeof(uint32)) {
+					continue;
+				}
+				int64 p = content;
+				uint32 id = readValue<uint32>(p);
+				if (id == eegId || (markers >= 0 && id == markerId)) {
+					std::vector<XDFChunk>& chunks = id == eegId ? eegChunks : markerChunks;
+					XDFChunk chunk = { p, end, chunks.empty() ? 0.0 : chunks.back().firstTs };
+
+					int64 count;
+					if (!readVarLen(p, end, count)) {
+						continue;
+					}
+					if (count > 0 && p + 1 + (int64)sizeof(double) <= end && base[p] == 8) {
+						p++;
+						chunk.firstTs = readValue<double>(p);
+					}
+					chunks.push_back(chunk);
+				}
+			}
+
+			eegClock = fitClock(eegOffsets);
+			markerClock = fitClock(markerOffsets);
+		}
+
+		/*
+		* Least squares line through the (collection time, offset) pairs of one stream
+		* @param offsets collection time and offset, interleaved
+		* @return identity if there are none
+		*/
+		static ClockModel fitClock(const std::vector<double>& offsets) {
+			ClockModel model;
+			const int n = (int)offsets.size() / 2;
+			if (n == 0) {
+				return model;
+			}
+			double meanT = 0, meanOffset = 0;
+			for (int i = 0; i < n; i++) {
+				meanT += offsets[2 * i];
+				meanOffset += offsets[2 * i + 1];
+			}
+			meanT /= n;
+			meanOffset /= n;
+
+			double cov = 0, var = 0;
+			for (int i = 0; i < n; i++) {
+				const double dt = offsets[2 * i] - meanT;
+				cov += dt * (offsets[2 * i + 1] - meanOffset);
+				var += dt * dt;
+			}
+			model.t0 = meanT;
+			model.offset = meanOffset;
+			model.drift = var > 0 ? cov / var : 0.0;
+			model.valid = true;
+			return model;
+		}
+
+		XDFCursor openCursor(const std::vector<XDFChunk>& chunks, size_t c = 0) const {
+			XDFCursor cursor = { c, 0, 0, 0, 0.0 };
+			if (c < chunks.size()) {
+				cursor.pos = chunks[c].content;
+				cursor.end = chunks[c].end;
+				if (!readVarLen(cursor.pos, cursor.end, cursor.remaining)) {
+					cursor.remaining = 0;
+				}
+				cursor.lastTs = chunks[c].firstTs;
+			}
+			return cursor;
+		}
+
+		/*
+		* True if the next sample lies entirely within its chunk
+		*/
+		bool sampleFits(const XDFCursor& cursor, const XDFStream& stream) const {
+			int64 p = cursor.pos;
+			if (p >= cursor.end) {
+				return false;
+			}
+			const uint8 tsBytes = base[p++];
+			if (tsBytes != 0 && tsBytes != 8) {
+				return false;
+			}
+			p += tsBytes;
+			if (stream.valueBytes > 0) {
+				return p + (int64)stream.channelCount * stream.valueBytes <= cursor.end;
+			}
+			for (int ch = 0; ch < stream.channelCount; ch++) {
+				int64 len;
+				if (!readVarLen(p, cursor.end, len) || len > cursor.end - p) {
+					return false;
+				}
+				p += len;
+			}
+			return true;
+		}
+
+		/*
+		* Timestamp of the next sample without consuming it, false at the end of the stream
+		*/
+		bool peekTimestamp(const std::vector<XDFChunk>& chunks, XDFCursor& cursor, const XDFStream& stream, double& ts) {
+			// A sample that does not fit ends its chunk, the rest of it is damaged
+			while (cursor.remaining == 0 || !sampleFits(cursor, stream)) {
+				if (cursor.chunk + 1 >= chunks.size()) {
+					return false;
+				}
+				double lastTs = cursor.lastTs;
+				cursor = openCursor(chunks, cursor.chunk + 1);
+				cursor.lastTs = lastTs;
+			}
+			XDFCursor peek = cursor;
+			ts = readTimestamp(peek, stream);
+			return true;
+		}
+
+		double readTimestamp(XDFCursor& cursor, const XDFStream& stream) {
+			if (base[cursor.pos++] == 8) {
+				cursor.lastTs = readValue<double>(cursor.pos);
+			}
+			else if (stream.srate > 0) {
+				cursor.lastTs += 1.0 / stream.srate;
+			}
+			return cursor.lastTs;
+		}
+
+		/*
+		* Reads the values after the timestamp and converts them to float
+		*/
+		void readSample(XDFCursor& cursor, const XDFStream& stream, float* dest) {
+			const uint8* src = base + cursor.pos;
+			for (int ch = 0; ch < stream.channelCount; ch++) {
+				switch (stream.valueBytes) {
+				case 1: dest[ch] = (float)((const int8*)src)[ch]; break;
+				case 2: dest[ch] = (float)((const int16*)src)[ch]; break;
+				case 4: dest[ch] = stream.format == "float32" ? ((const float*)src)[ch] : (float)((const int32*)src)[ch]; break;
+				case 8: dest[ch] = stream.format == "double64" ? (float)((const double*)src)[ch] : (float)((const int64*)src)[ch]; break;
+				}
+			}
+			cursor.pos += stream.channelCount * stream.valueBytes;
+			cursor.remaining--;
+		}
+
+		void skipSample(const std::vector<XDFChunk>& chunks, XDFCursor& cursor, const XDFStream& stream) {
+			readTimestamp(cursor, stream);
+			cursor.pos += stream.channelCount * stream.valueBytes;
+			cursor.remaining--;
+		}
+
+		/*
+		* Next marker (first channel only) without consuming it; call with pendingMarker cleared to consume
+		*/
+		bool nextMarker(std::string& text, double& ts) {
+			if (pendingMarker) {
+				text = markerText;
+				ts = markerTs;
+				return true;
+			}
+			if (markers < 0) {
+				return false;
+			}
+			const XDFStream& stream = streams[markers];
+			if (!peekTimestamp(markerChunks, marker, stream, markerTs)) {
+				return false;
+			}
+			markerTs = markerClock.map(readTimestamp(marker, stream));
+
+			if (stream.valueBytes == 0) {
+				for (int ch = 0; ch < stream.channelCount; ch++) {
+					int64 len = 0;
+					readVarLen(marker.pos, marker.end, len);
+					if (ch == 0) {
+						markerText.assign((const char*)(base + marker.pos), len);
+					}
+					marker.pos += len;
+				}
+				marker.remaining--;
+			}
+			else {
+				std::vector<float> values(stream.channelCount);
+				readSample(marker, stream, values.data());
+				markerText = std::to_string((int)values[0]);
+			}
+
+			pendingMarker = true;
+			text = markerText;
+			ts = markerTs;
+			return true;
+		}
+
+		MemoryMappedFile map;
+		const uint8* base;
+		int64 size;
+
+		std::vector<XDFStream> streams;
+		int eeg = -1;
+		int markers = -1;
+
+		bool indexed;
+		std::vector<XDFChunk> eegChunks;
+		std::vector<XDFChunk> markerChunks;
+
+		// Recorded timestamps to the recorder's clock
+		ClockModel eegClock;
+		ClockModel markerClock;
+
+		XDFCursor data;
+		XDFCursor marker;
+		bool pendingMarker;
+		std::string markerText;
+		double markerTs;
+
+		StreamAligner aligner;
+		std::vector<int> markerCodes;
+		std::vector<int> markerCodeInds;
+
+		ReplayPacer pacer;
+		double startOffset;
+		double initTs;
+
+		JUCE_LEAK_DETECTOR(XDFPlayback);
+	};
+}
+
+#endif // OEP_XDF_PLAYBACK_H_INCLUDED
@@ -0,0 +1,486 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a library for the Open Ephys GUI
+Copyright (C) 2017 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Streaming XDF recorder
+
+
+Records the raw inlet data the way LabRecorder would: stream headers, sample chunks with the
+original LSL timestamps, clock offset chunks from time_correction() and the marker stream.
+Markers are written in the channel format their stream header declares: integer marker
+streams arrive as codes and stay numbers, text is parsed for the other numeric formats.
+Only the first channel of a marker stream is pulled, so a marker stream with more than one
+channel is left out of the file rather than written with samples that do not match its header.
+
+The receive thread only copies each pulled chunk into a lock-free byte FIFO. Encoding, clock
+offset probes and file writes all happen on the recorder's own thread, in batches. If the FIFO
+is full the chunk is dropped and counted rather than making the receive thread wait.
+
+The recorder shares ownership of the inlets it probes, so one that acquisition reopens stays
+valid until the recorder is handed its replacement with replaceInlet().
+*/
+
+#ifndef OEP_XDF_RECORDER_H_INCLUDED
+#define OEP_XDF_RECORDER_H_INCLUDED
+
+#include <CommonLibHeader.h>
+#include <lsl_cpp.h>
+#include <cstdlib>
+#include "XDFFormat.h"
+#include "LSLClockSync.h"
+
+namespace LSLinletNode
+{
+	const int XDF_FIFO_BYTES = 16 * 1024 * 1024;
+	const double XDF_OFFSET_INTERVAL = 5.0;
+	const double XDF_BOUNDARY_INTERVAL = 10.0;
+
+	class XDFRecorder : public Thread
+	{
+	public:
+		enum
+		{
+			EEG_ID = 1,
+			MARKER_ID = 2
+		};
+
+		/*
+		* @param f output file, overwritten
+		* @param eeg inlet of the data stream, used for its header and time_correction()
+		* @param markers inlet of the marker stream
+		*/
+		XDFRecorder(const File& f, InletHandle eeg, InletHandle markers) :
+			Thread("XDF Recorder"),
+			file(f),
+			eegInlet(eeg),
+			markerInlet(markers),
+			numericMarkers(false),
+			recordMarkers(false),
+			fifo(XDF_FIFO_BYTES),
+			ring(XDF_FIFO_BYTES),
+			dropped(0)
+		{
+			int32_t ec = 0;
+			lsl_streaminfo info = lsl_get_fullinfo(eegInlet.get(), 1.0, &ec);
+			if (ec != 0) {
+				return;
+			}
+			eegInfo = lsl::stream_info(info);
+			info = lsl_get_fullinfo(markerInlet.get(), 1.0, &ec);
+			if (ec != 0) {
+				return;
+			}
+			markerInfo = lsl::stream_info(info);
+			numChannels = eegInfo.channel_count();
+			const int markerFormat = markerInfo.channel_format();
+			numericMarkers = markerFormat == lsl::cf_int32 || markerFormat == lsl::cf_int16 || markerFormat == lsl::cf_int8;
+			recordMarkers = markerInfo.channel_count() == 1;
+			if (!recordMarkers) {
+				std::cout << "XDF recorder: marker stream " << markerInfo.name() << " has " << markerInfo.channel_count()
+					<< " channels, markers are not recorded" << std::endl;
+			}
+
+			file.deleteFile();
+			out = new FileOutputStream(file);
+			if (out->failedToOpen()) {
+				out = nullptr;
+				return;
+			}
+
+			const char magic[4] = { 'X', 'D', 'F', ':' };
+			batch.insert(batch.end(), magic, magic + 4);
+			std::string header = "<?xml version=\"1.0\"?><info><version>1.0</version></info>";
+			beginChunk(XDF_FILE_HEADER, header.size());
+			append(header.data(), header.size());
+
+			writeStreamHeader(EEG_ID, eegInfo);
+			if (recordMarkers) {
+				writeStreamHeader(MARKER_ID, markerInfo);
+			}
+			flushBatch();
+
+			startThread();
+		}
+
+		~XDFRecorder() {
+			signalThreadShouldExit();
+			notify();
+			stopThread(5000);
+
+			if (out != nullptr) {
+				writeStreamFooter(EEG_ID, eegStats);
+				if (recordMarkers) {
+					writeStreamFooter(MARKER_ID, markerStats);
+				}
+				flushBatch();
+			}
+
+			if (dropped > 0) {
+				std::cout << "XDF recorder dropped " << dropped << " chunks, writer could not keep up" << std::endl;
+			}
+		}
+
+		bool isOpen() const {
+			return out != nullptr;
+		}
+
+		/*
+		* Called from the receive thread with a chunk exactly as pulled (multiplexed floats)
+		*/
+		void writeChunk(const float* data, const double* ts, int nSamps) {
+			ItemHeader item = { EEG_ID, (uint32)nSamps };
+			push(item, ts, nSamps * sizeof(double), data, nSamps * numChannels * sizeof(float));
+		}
+
+		/*
+		* Probe a reopened inlet from now on. The header already written still describes the stream.
+		* @param id EEG_ID or MARKER_ID
+		*/
+		void replaceInlet(uint32 id, InletHandle inlet) {
+			const SpinLock::ScopedLockType lock(inletLock);
+			(id == EEG_ID ? nextEegInlet : nextMarkerInlet) = inlet;
+		}
+
+		/*
+		* Called from the receive thread with a marker of a string or floating point stream
+		*/
+		void writeMarker(const std::string& text, double ts) {
+			if (!recordMarkers) {
+				return;
+			}
+			ItemHeader item = { MARKER_ID, (uint32)text.size() };
+			push(item, &ts, sizeof(double), text.data(), text.size());
+		}
+
+		/*
+		* Called from the receive thread with a marker of an integer stream
+		*/
+		void writeMarker(int32_t code, double ts) {
+			if (!recordMarkers) {
+				return;
+			}
+			ItemHeader item = { MARKER_ID, (uint32)sizeof(int32_t) };
+			push(item, &ts, sizeof(double), &code, sizeof(int32_t));
+		}
+
+		void run() override {
+			double nextOffset = 0;
+			double nextBoundary = lsl::local_clock() + XDF_BOUNDARY_INTERVAL;
+			std::vector<uint8> payload;
+
+			while (true) {
+				bool exiting = threadShouldExit();
+
+				// Drain everything queued so far into one batch
+				ItemHeader item;
+				while (fifo.getNumReady() >= (int)sizeof(ItemHeader)) {
+					read(&item, sizeof(ItemHeader));
+					double* ts;
+					if (item.stream == EEG_ID) {
+						payload.resize(item.count * (sizeof(double) + numChannels * sizeof(float)));
+						read(payload.data(), payload.size());
+						ts = (double*)payload.data();
+						writeSamples((const float*)(ts + item.count), ts, item.count);
+					}
+					else {
+						payload.resize(sizeof(double) + item.count);
+						read(payload.data(), payload.size());
+						ts = (double*)payload.data();
+						writeMarkerChunk((const char*)(ts + 1), item.count, ts[0]);
+					}
+				}
+
+				double now = lsl::local_clock();
+				if (now >= nextOffset && !exiting) {
+					takeReplacements();
+					writeClockOffset(EEG_ID, eegInlet);
+					if (recordMarkers) {
+						writeClockOffset(MARKER_ID, markerInlet);
+					}
+					nextOffset = lsl::local_clock() + XDF_OFFSET_INTERVAL;
+				}
+				if (now >= nextBoundary) {
+					beginChunk(XDF_BOUNDARY, sizeof(XDF_BOUNDARY_UUID));
+					append(XDF_BOUNDARY_UUID, sizeof(XDF_BOUNDARY_UUID));
+					nextBoundary = now + XDF_BOUNDARY_INTERVAL;
+				}
+
+				flushBatch();
+
+				if (exiting) {
+					break;
+				}
+				wait(100);
+			}
+		}
+
+	private:
+		struct ItemHeader
+		{
+			uint32 stream;
+			uint32 count;
+		};
+
+		struct StreamStats
+		{
+			double first = 0;
+			double last = 0;
+			int64 count = 0;
+		};
+
+		// Receive thread side
+
+		void push(const ItemHeader& item, const void* a, size_t aBytes, const void* b, size_t bBytes) {
+			int total = int(sizeof(ItemHeader) + aBytes + bBytes);
+			if (fifo.getFreeSpace() < total) {
+				dropped++;
+				return;
+			}
+			int start1, size1, start2, size2;
+			fifo.prepareToWrite(total, start1, size1, start2, size2);
+
+			int written = 0;
+			auto copy = [&](const void* src, int bytes) {
+				const uint8* s = (const uint8*)src;
+				for (int i = 0; i < bytes; ) {
+					int pos = written < size1 ? start1 + written : start2 + written - size1;
+					int n = jmin(bytes - i, written < size1 ? size1 - written : size2 - (written - size1));
+					memcpy(ring.data() + pos, s + i, n);
+					i += n;
+					written += n;
+				}
+			};
+			copy(&item, sizeof(ItemHeader));
+			copy(a, (int)aBytes);
+			copy(b, (int)bBytes);
+
+			fifo.finishedWrite(total);
+		}
+
+		// Recorder thread side
+
+		void read(void* dest, size_t bytes) {
+			int start1, size1, start2, size2;
+			fifo.prepareToRead((int)bytes, start1, size1, start2, size2);
+			memcpy(dest, ring.data() + start1, size1);
+			memcpy((uint8*)dest + size1, ring.data() + start2, size2);
+			fifo.finishedRead(size1 + size2);
+		}
+
+		void append(const void* src, size_t bytes) {
+			const uint8* s = (const uint8*)src;
+			batch.insert(batch.end(), s, s + bytes);
+		}
+
+		template <typename T>
+		void appendValue(T value) {
+			append(&value, sizeof(T));
+		}
+
+		void appendVarLen(uint64 value) {
+			if (value < 256) {
+				appendValue<uint8>(1);
+				appendValue<uint8>((uint8)value);
+			}
+			else if (value <= 0xFFFFFFFF) {
+				appendValue<uint8>(4);
+				appendValue<uint32>((uint32)value);
+			}
+			else {
+				appendValue<uint8>(8);
+				appendValue<uint64>(value);
+			}
+		}
+
+		void beginChunk(uint16 tag, size_t contentBytes) {
+			appendVarLen(contentBytes + sizeof(uint16));
+			appendValue<uint16>(tag);
+		}
+
+		void writeStreamHeader(uint32 id, lsl::stream_info& info) {
+			std::string xml = info.as_xml();
+			beginChunk(XDF_STREAM_HEADER, sizeof(uint32) + xml.size());
+			appendValue<uint32>(id);
+			append(xml.data(), xml.size());
+		}
+
+		void writeStreamFooter(uint32 id, const StreamStats& stats) {
+			std::string xml = "<?xml version=\"1.0\"?><info><first_timestamp>" + std::to_string(stats.first)
+				+ "</first_timestamp><last_timestamp>" + std::to_string(stats.last)
+				+ "</last_timestamp><sample_count>" + std::to_string(stats.count)
+				+ "</sample_count></info>";
+			beginChunk(XDF_STREAM_FOOTER, sizeof(uint32) + xml.size());
+			appendValue<uint32>(id);
+			append(xml.data(), xml.size());
+		}
+
+		static size_t valueBytes(lsl::channel_format_t format) {
+			return format == lsl::cf_double64 || format == lsl::cf_int64 ? 8
+				: format == lsl::cf_int16 ? 2 : format == lsl::cf_int8 ? 1 : 4;
+		}
+
+		void appendSampleValue(lsl::channel_format_t format, double value) {
+			switch (format) {
+			case lsl::cf_double64: appendValue<double>(value); break;
+			case lsl::cf_int64: appendValue<int64>((int64)value); break;
+			case lsl::cf_int32: appendValue<int32>((int32)value); break;
+			case lsl::cf_int16: appendValue<int16>((int16)value); break;
+			case lsl::cf_int8: appendValue<int8>((int8)value); break;
+			default: appendValue<float>((float)value); break;
+			}
+		}
+
+		/*
+		* Values go back into the stream's own channel format, exact for the 8 and 16 bit
+		* integer formats and float32, and for 32 bit integers up to 2^24
+		*/
+		void writeSamples(const float* data, const double* ts, uint32 nSamps) {
+			lsl::channel_format_t format = eegInfo.channel_format();
+			size_t bytes = valueBytes(format);
+
+			size_t countBytes = nSamps < 256 ? 2 : 5;
+			beginChunk(XDF_SAMPLES, sizeof(uint32) + countBytes + nSamps * (1 + sizeof(double) + numChannels * bytes));
+			appendValue<uint32>(EEG_ID);
+			appendVarLen(nSamps);
+
+			for (uint32 i = 0; i < nSamps; i++) {
+				appendValue<uint8>(8);
+				appendValue<double>(ts[i]);
+				const float* sample = data + i * numChannels;
+				for (int ch = 0; ch < numChannels; ch++) {
+					appendSampleValue(format, sample[ch]);
+				}
+			}
+
+			updateStats(eegStats, ts[0], ts[nSamps - 1], nSamps);
+		}
+
+		/*
+		* One marker sample in the format the header declares; value is an int32 code for
+		* integer streams and text otherwise
+		*/
+		void writeMarkerChunk(const char* value, uint32 bytes, double ts) {
+			lsl::channel_format_t format = markerInfo.channel_format();
+			if (format == lsl::cf_string) {
+				size_t lenBytes = bytes < 256 ? 2 : 5;
+				beginChunk(XDF_SAMPLES, sizeof(uint32) + 2 + 1 + sizeof(double) + lenBytes + bytes);
+				appendValue<uint32>(MARKER_ID);
+				appendVarLen(1);
+				appendValue<uint8>(8);
+				appendValue<double>(ts);
+				appendVarLen(bytes);
+				append(value, bytes);
+			}
+			else {
+				double number = 0;
+				if (numericMarkers) {
+					int32_t code;
+					memcpy(&code, value, sizeof(int32_t));
+					number = code;
+				}
+				else {
+					number = std::strtod(std::string(value, bytes).c_str(), nullptr);
+				}
+				beginChunk(XDF_SAMPLES, sizeof(uint32) + 2 + 1 + sizeof(double) + valueBytes(format));
+				appendValue<uint32>(MARKER_ID);
+				appendVarLen(1);
+				appendValue<uint8>(8);
+				appendValue<double>(ts);
+				appendSampleValue(format, number);
+			}
+
+			updateStats(markerStats, ts, ts, 1);
+		}
+
+		// Swap in inlets handed over by replaceInlet(); the old ones are released here, not by the caller
+		void takeReplacements() {
+			InletHandle eeg, markers;
+			{
+				const SpinLock::ScopedLockType lock(inletLock);
+				eeg.swap(nextEegInlet);
+				markers.swap(nextMarkerInlet);
+			}
+			if (eeg != nullptr) {
+				eegInlet.swap(eeg);
+			}
+			if (markers != nullptr) {
+				markerInlet.swap(markers);
+			}
+		}
+
+		void writeClockOffset(uint32 id, const InletHandle& inlet) {
+			int32_t ec = 0;
+			double offset = lsl_time_correction(inlet.get(), 2.0, &ec);
+			if (ec != 0) {
+				// No answer from the outlet, try again next interval
+				return;
+			}
+			beginChunk(XDF_CLOCK_OFFSET, sizeof(uint32) + 2 * sizeof(double));
+			appendValue<uint32>(id);
+			appendValue<double>(lsl::local_clock() - offset);
+			appendValue<double>(offset);
+		}
+
+		void updateStats(StreamStats& stats, double first, double last, int64 count) {
+			if (stats.count == 0) {
+				stats.first = first;
+			}
+			stats.last = last;
+			stats.count += count;
+		}
+
+		void flushBatch() {
+			if (out != nullptr && !batch.empty()) {
+				out->write(batch.data(), batch.size());
+				out->flush();
+			}
+			batch.clear();
+		}
+
+		File file;
+		ScopedPointer<FileOutputStream> out;
+		std::vector<uint8> batch;
+
+		InletHandle eegInlet;
+		InletHandle markerInlet;
+		InletHandle nextEegInlet;
+		InletHandle nextMarkerInlet;
+		SpinLock inletLock;
+		lsl::stream_info eegInfo;
+		lsl::stream_info markerInfo;
+		int numChannels;
+		bool numericMarkers;
+		bool recordMarkers;
+
+		AbstractFifo fifo;
+		std::vector<uint8> ring;
+		std::atomic<int64> dropped;
+
+		StreamStats eegStats;
+		StreamStats markerStats;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(XDFRecorder);
+	};
+}
+
+#endif // OEP_XDF_RECORDER_H_INCLUDED
@@ -1,4 +1,9 @@
-"""Example program to demonstrate how to send string-valued markers into LSL."""
+"""Example program to demonstrate how to send string-valued markers into LSL.
+With -r the markers are sent at a fixed rate (e.g. -r 1000 for 1 kHz tagging),
+and with -i as int32 instead of strings, to compare marker throughput."""
+
+import sys
+import getopt
 
 import random
 import time
@@ -6,7 +11,24 @@ import time
 from pylsl import StreamInfo, StreamOutlet
 
 
-def main():
+def main(argv):
+    rate = 0
+    numeric = False
+    help_string = 'lslsendevents.py -r <markers_per_second> -i'
+    try:
+        opts, args = getopt.getopt(argv, "hr:i", longopts=["rate=", "int32"])
+    except getopt.GetoptError:
+        print(help_string)
+        sys.exit(2)
+    for opt, arg in opts:
+        if opt == '-h':
+            print(help_string)
+            sys.exit()
+        elif opt in ("-r", "--rate"):
+            rate = float(arg)
+        elif opt in ("-i", "--int32"):
+            numeric = True
+
     # first create a new stream info (here we set the name to MyMarkerStream,
     # the content-type to Markers, 1 channel, irregular sampling rate,
     # and string-valued data) The last value would be the locally unique
@@ -15,18 +37,31 @@ def main():
     # connections wouldn't auto-recover). The important part is that the
     # content-type is set to 'Markers', because then other programs will know how
     #  to interpret the content
-    info = StreamInfo('MyMarkerStream', 'Markers', 1, 0, 'string', 'myuidw43536')
+    info = StreamInfo('MyMarkerStream', 'Markers', 1, 0, 'int32' if numeric else 'string', 'myuidw43536')
 
     # next make an outlet
     outlet = StreamOutlet(info)
 
     print("now sending markers...")
     markernames = ['1', '2', '3', '4', '5', '6']
+    if rate <= 0:
+        while True:
+            # pick a sample to send an wait for a bit
+            marker = random.choice(markernames)
+            outlet.push_sample([int(marker) if numeric else marker])
+            time.sleep(random.random() * 3)
+
+    # fixed rate, catching up in chunks when the sleep overshoots
+    start_time = time.time()
+    sent = 0
     while True:
-        # pick a sample to send an wait for a bit
-        outlet.push_sample([random.choice(markernames)])
-        time.sleep(random.random() * 3)
+        required = int(rate * (time.time() - start_time)) - sent
+        if required > 0:
+            markers = [random.choice(markernames) for _ in range(required)]
+            outlet.push_chunk([[int(m)] if numeric else [m] for m in markers])
+            sent += required
+        time.sleep(0.001)
 
 
 if __name__ == '__main__':
-    main()
\ No newline at end of file
+    main(sys.argv[1:])
@@ -0,0 +1,143 @@
+"""Example program to send a multi-channel time-series and markers to the
+LSL inlet plugin through its shared memory ring (same host, no LSL needed).
+Set the plugin's shared memory name to the same name; channel count and
+sample rate are read from the ring. Layout is described in Source/ShmRing.h."""
+import sys
+import getopt
+
+import ctypes
+import mmap
+import os
+import platform
+import struct
+import time
+from random import random as rand
+
+MAGIC = b'OESHMRG1'
+HEADER_BYTES = 64
+MARKER_BYTES = 64
+WRITE_INDEX = 32
+MARKER_WRITE_INDEX = 40
+SEQ = 48
+WAITING = 52
+
+
+class ShmRing:
+    def __init__(self, name, n_channels, srate, capacity, marker_capacity=256):
+        self.n_channels = n_channels
+        self.capacity = 1 << (capacity - 1).bit_length()
+        self.marker_capacity = 1 << (marker_capacity - 1).bit_length()
+        # the plugin does not read the last max_block slots before the write position
+        self.max_block = max(1, self.capacity // 4)
+        self.ts_offset = HEADER_BYTES
+        self.data_offset = self.ts_offset + 8 * self.capacity
+        self.marker_offset = self.data_offset + 4 * self.capacity * n_channels
+        size = self.marker_offset + MARKER_BYTES * self.marker_capacity
+        self.write_index = 0
+        self.marker_index = 0
+        self.event = None
+
+        if os.name == 'nt':
+            self.buf = mmap.mmap(-1, size, tagname=name)
+            kernel32 = ctypes.windll.kernel32
+            self.event = kernel32.CreateEventW(None, False, False, name + '_ready')
+            self.wake = lambda: kernel32.SetEvent(self.event)
+        else:
+            # POSIX shared memory objects live in /dev/shm on Linux
+            self.path = '/dev/shm/' + name.lstrip('/')
+            fd = os.open(self.path, os.O_CREAT | os.O_RDWR, 0o666)
+            os.ftruncate(fd, size)
+            self.buf = mmap.mmap(fd, size)
+            os.close(fd)
+            self.wake = self.futex_wake if platform.system() == 'Linux' else lambda: None
+
+        struct.pack_into('<IIIId', self.buf, 8, n_channels, self.capacity, self.marker_capacity, self.max_block, srate)
+        struct.pack_into('<QQII', self.buf, WRITE_INDEX, 0, 0, 0, 0)
+        # magic last, the plugin only trusts the header once it is there
+        self.buf[0:8] = MAGIC
+
+    def futex_wake(self):
+        libc = ctypes.CDLL(None, use_errno=True)
+        sys_futex = {'x86_64': 202, 'aarch64': 98}.get(platform.machine())
+        if sys_futex is None:
+            return
+        addr = ctypes.addressof(ctypes.c_char.from_buffer(self.buf, SEQ))
+        libc.syscall(sys_futex, ctypes.c_void_p(addr), 1, 1, None, None, 0)  # FUTEX_WAKE, one waiter
+
+    def push(self, values, count, timestamps=None):
+        # values is count x channels, multiplexed; timestamps None = the plugin stamps on arrival
+        for i in range(count):
+            slot = (self.write_index + i) & (self.capacity - 1)
+            row = values[i * self.n_channels:(i + 1) * self.n_channels]
+            struct.pack_into('<%df' % self.n_channels, self.buf, self.data_offset + 4 * slot * self.n_channels, *row)
+            struct.pack_into('<d', self.buf, self.ts_offset + 8 * slot, timestamps[i] if timestamps else 0.0)
+            # publish at least every max_block samples
+            if (i + 1) % self.max_block == 0 or i + 1 == count:
+                self.publish(self.write_index + i + 1)
+        self.write_index += count
+
+    def publish(self, write_index):
+        struct.pack_into('<Q', self.buf, WRITE_INDEX, write_index)
+        seq, waiting = struct.unpack_from('<II', self.buf, SEQ)
+        struct.pack_into('<I', self.buf, SEQ, (seq + 1) & 0xFFFFFFFF)
+        if waiting:
+            self.wake()
+
+    def push_marker(self, text):
+        # applies to the next sample pushed
+        slot = self.marker_index & (self.marker_capacity - 1)
+        struct.pack_into('<Q56s', self.buf, self.marker_offset + MARKER_BYTES * slot, self.write_index, text.encode()[:55])
+        self.marker_index += 1
+        struct.pack_into('<Q', self.buf, MARKER_WRITE_INDEX, self.marker_index)
+
+    def close(self):
+        self.buf.close()
+        if os.name != 'nt':
+            os.unlink(self.path)
+
+
+def main(argv):
+    srate = 1000
+    n_channels = 8
+    name = '/oe_eeg'
+    help_string = 'shmstream.py -s <sampling_rate> -c <channels> -n <name>'
+    try:
+        opts, args = getopt.getopt(argv, "hs:c:n:", longopts=["srate=", "channels=", "name="])
+    except getopt.GetoptError:
+        print(help_string)
+        sys.exit(2)
+    for opt, arg in opts:
+        if opt == '-h':
+            print(help_string)
+            sys.exit()
+        elif opt in ("-s", "--srate"):
+            srate = float(arg)
+        elif opt in ("-c", "--channels"):
+            n_channels = int(arg)
+        elif opt in ("-n", "--name"):
+            name = arg
+
+    # two seconds of room
+    ring = ShmRing(name, n_channels, srate, int(srate * 2))
+    print("now sending data...")
+    start_time = time.time()
+    sent_samples = 0
+    next_marker = 1
+    try:
+        while True:
+            elapsed_time = time.time() - start_time
+            required_samples = int(srate * elapsed_time) - sent_samples
+            if required_samples > 0:
+                if elapsed_time > next_marker:
+                    ring.push_marker(str(next_marker % 8 + 1))
+                    next_marker += 1
+                values = [rand() * 1000 for _ in range(required_samples * n_channels)]
+                ring.push(values, required_samples)
+                sent_samples += required_samples
+            time.sleep(0.02)
+    except KeyboardInterrupt:
+        ring.close()
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
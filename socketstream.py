@@ -0,0 +1,77 @@
+"""Example program to send a multi-channel time-series and markers to the
+LSL inlet plugin over its framed binary socket backend (no LSL needed).
+Set the plugin's socket address to tcp:<port> or udp:<port> and its channel
+count and sample rate to match."""
+import sys
+import getopt
+
+import socket
+import struct
+import time
+from random import random as rand
+
+FRAME_DATA = 0
+FRAME_MARKER = 1
+
+
+def frame(frame_type, count, channels, timestamp, payload):
+    # magic, type, count, channels, timestamp (0 = stamp on arrival)
+    return struct.pack('<4sIIId', b'OESF', frame_type, count, channels, timestamp) + payload
+
+
+def main(argv):
+    srate = 1000
+    n_channels = 8
+    host = '127.0.0.1'
+    port = 5000
+    udp = False
+    help_string = 'socketstream.py -s <sampling_rate> -c <channels> -a <host> -p <port> [-u]'
+    try:
+        opts, args = getopt.getopt(argv, "hs:c:a:p:u", longopts=["srate=", "channels=", "host=", "port=", "udp"])
+    except getopt.GetoptError:
+        print(help_string)
+        sys.exit(2)
+    for opt, arg in opts:
+        if opt == '-h':
+            print(help_string)
+            sys.exit()
+        elif opt in ("-s", "--srate"):
+            srate = float(arg)
+        elif opt in ("-c", "--channels"):
+            n_channels = int(arg)
+        elif opt in ("-a", "--host"):
+            host = arg
+        elif opt in ("-p", "--port"):
+            port = int(arg)
+        elif opt in ("-u", "--udp"):
+            udp = True
+
+    if udp:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        send = lambda data: sock.sendto(data, (host, port))
+    else:
+        sock = socket.create_connection((host, port))
+        send = sock.sendall
+
+    print("now sending data...")
+    start_time = time.time()
+    sent_samples = 0
+    next_marker = 1
+    while True:
+        elapsed_time = time.time() - start_time
+        required_samples = int(srate * elapsed_time) - sent_samples
+        if required_samples > 0:
+            # a marker lands on the first sample sent after it
+            if elapsed_time > next_marker:
+                text = str(next_marker % 8 + 1).encode()
+                send(frame(FRAME_MARKER, len(text), 0, 0, text))
+                next_marker += 1
+            values = [rand() * 1000 for _ in range(required_samples * n_channels)]
+            payload = struct.pack('<%df' % len(values), *values)
+            send(frame(FRAME_DATA, required_samples, n_channels, 0, payload))
+            sent_samples += required_samples
+        time.sleep(0.02)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])